@@ -0,0 +1,72 @@
+#include "BumpArena.hpp"
+#include <cstring>
+#include <new>
+
+static const size_t ALIGNMENT = 16;
+
+static size_t alignUp(size_t n) {
+    return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+BumpArena::BumpArena(size_t blockSize) : _current(0), _used(0), _blockSize(blockSize) {}
+
+BumpArena::~BumpArena() {
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        ::operator delete(_blocks[i].data);
+    }
+}
+
+void* BumpArena::allocate(size_t size) {
+    size = alignUp(size == 0 ? 1 : size);
+    while (_current < _blocks.size()) {
+        Block& block = _blocks[_current];
+        if (_used + size <= block.size) {
+            void* p = block.data + _used;
+            _used += size;
+            return p;
+        }
+        // Move on; the tail of this block stays unused until reset()
+        ++_current;
+        _used = 0;
+    }
+    Block block;
+    block.size = size > _blockSize ? size : _blockSize;
+    block.data = static_cast<char*>(::operator new(block.size));
+    _blocks.push_back(block);
+    _current = _blocks.size() - 1;
+    _used = size;
+    return block.data;
+}
+
+void* BumpArena::grow(void* last, size_t oldSize, size_t newSize) {
+    if (last != NULL && _current < _blocks.size()) {
+        Block& block = _blocks[_current];
+        char* start = static_cast<char*>(last);
+        // Only the newest allocation can grow in place
+        if (start >= block.data && start < block.data + block.size) {
+            size_t offset = static_cast<size_t>(start - block.data);
+            if (offset + alignUp(oldSize) == _used && offset + alignUp(newSize) <= block.size) {
+                _used = offset + alignUp(newSize);
+                return last;
+            }
+        }
+    }
+    void* fresh = allocate(newSize);
+    if (last != NULL) {
+        std::memcpy(fresh, last, oldSize);
+    }
+    return fresh;
+}
+
+void BumpArena::reset() {
+    _current = 0;
+    _used = 0;
+}
+
+size_t BumpArena::capacity() const {
+    size_t total = 0;
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        total += _blocks[i].size;
+    }
+    return total;
+}
@@ -0,0 +1,40 @@
+#ifndef BUMPARENA_HPP
+#define BUMPARENA_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Scratch memory for one event-loop iteration. Allocation is a pointer bump
+// inside the current block; nothing is freed individually. reset() at the
+// end of the iteration rewinds every block, and blocks are kept, so once
+// the busiest iteration has been seen the arena stops calling the heap.
+class BumpArena {
+public:
+    explicit BumpArena(size_t blockSize = 16384);
+    ~BumpArena();
+
+    // size bytes aligned for any scalar type
+    void* allocate(size_t size);
+    // Extends the most recent allocation to newSize, in place when it fits,
+    // otherwise by copying into a fresh region
+    void* grow(void* last, size_t oldSize, size_t newSize);
+    void reset();
+
+    size_t capacity() const;
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> _blocks;
+    size_t _current;                // Block being bumped
+    size_t _used;                   // Bytes used in the current block
+    size_t _blockSize;
+
+    BumpArena(const BumpArena&);
+    BumpArena& operator=(const BumpArena&);
+};
+
+#endif // BUMPARENA_HPP
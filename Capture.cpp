@@ -0,0 +1,223 @@
+#include "Capture.hpp"
+#include "Logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = { 'I', 'R', 'C', 'C', 'A', 'P', '1', '\n' };
+// Longest line a reader accepts, well above MAX_LINE_LENGTH
+static const unsigned long MAX_RECORD_LINE = 1UL << 20;
+
+static long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static size_t putVarint(char* out, unsigned long value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<char>(value);
+    return n;
+}
+
+// Retries short writes; false on an error
+static bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+CaptureWriter::CaptureWriter(const std::string& path)
+    : _ring(RING_BYTES), _head(0), _tail(0), _lastNs(monotonicNs()), _records(0), _dropped(0), _gap(0),
+      _fd(-1), _running(1), _wakePending(0), _wakeRead(-1), _wakeWrite(-1) {
+    _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open capture file " + path + ": " + strerror(errno));
+    }
+    int fds[2];
+    if (!writeAll(_fd, MAGIC, sizeof(MAGIC)) || pipe(fds) < 0) {
+        close(_fd);
+        throw std::runtime_error("Failed to start capture to " + path);
+    }
+    _wakeRead = fds[0];
+    _wakeWrite = fds[1];
+    fcntl(_wakeRead, F_SETFL, O_NONBLOCK);
+    fcntl(_wakeWrite, F_SETFL, O_NONBLOCK);
+    fcntl(_wakeRead, F_SETFD, FD_CLOEXEC);
+    fcntl(_wakeWrite, F_SETFD, FD_CLOEXEC);
+    if (pthread_create(&_writer, NULL, &CaptureWriter::writerMain, this) != 0) {
+        close(_wakeRead);
+        close(_wakeWrite);
+        close(_fd);
+        throw std::runtime_error("Failed to start capture writer thread");
+    }
+}
+
+CaptureWriter::~CaptureWriter() {
+    __atomic_store_n(&_running, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&_wakePending, 1, __ATOMIC_SEQ_CST);
+    char byte = 1;
+    ssize_t ignored = write(_wakeWrite, &byte, 1);
+    (void)ignored;
+    pthread_join(_writer, NULL);
+    drain();
+    close(_wakeRead);
+    close(_wakeWrite);
+    if (_fd >= 0) close(_fd);
+    LOG_INFO("Capture finished: " << _records << " records, " << _dropped << " dropped");
+}
+
+// Called with the server's state lock held
+void CaptureWriter::record(CaptureKind kind, unsigned long conn, const char* data, size_t len) {
+    long now = monotonicNs();
+    if (now < _lastNs) now = _lastNs;
+    if (_gap != 0) {
+        if (!append(CAPTURE_GAP, _gap, NULL, 0, now)) {
+            ++_gap;
+            ++_dropped;
+            return;
+        }
+        _gap = 0;
+    }
+    if (!append(kind, conn, data, len, now)) {
+        ++_gap;
+        ++_dropped;
+        return;
+    }
+    ++_records;
+    if (__atomic_exchange_n(&_wakePending, 1, __ATOMIC_SEQ_CST) == 0) {
+        char byte = 1;
+        ssize_t ignored = write(_wakeWrite, &byte, 1);
+        (void)ignored;
+    }
+}
+
+bool CaptureWriter::append(CaptureKind kind, unsigned long conn, const char* data, size_t len, long now) {
+    char head[1 + 4 * 10];
+    size_t n = 0;
+    head[n++] = static_cast<char>(kind);
+    n += putVarint(head + n, static_cast<unsigned long>(now - _lastNs));
+    n += putVarint(head + n, conn);
+    if (kind == CAPTURE_LINE) n += putVarint(head + n, len);
+
+    unsigned long used = _head - __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+    if (RING_BYTES - used < n + len) return false;
+    copyIn(_head, head, n);
+    if (len > 0) copyIn(_head + n, data, len);
+    _lastNs = now;
+    __atomic_store_n(&_head, _head + n + len, __ATOMIC_RELEASE);
+    return true;
+}
+
+void CaptureWriter::copyIn(unsigned long pos, const char* data, size_t len) {
+    size_t offset = pos & (RING_BYTES - 1);
+    size_t first = len < RING_BYTES - offset ? len : RING_BYTES - offset;
+    std::memcpy(&_ring[offset], data, first);
+    std::memcpy(&_ring[0], data + first, len - first);
+}
+
+// Writes out everything published so far, at most two write() calls when
+// the data wraps around the ring. Writer thread only, or after it has been
+// joined. After a write error the file is abandoned, but the ring keeps
+// draining so producers only ever see it full when the disk is slow.
+size_t CaptureWriter::drain() {
+    unsigned long head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+    unsigned long pos = _tail;
+    while (pos != head) {
+        size_t offset = pos & (RING_BYTES - 1);
+        size_t chunk = head - pos < RING_BYTES - offset ? head - pos : RING_BYTES - offset;
+        if (_fd >= 0 && !writeAll(_fd, &_ring[offset], chunk)) {
+            LOG_ERROR("Capture write failed, recording stopped: " << strerror(errno));
+            close(_fd);
+            _fd = -1;
+        }
+        pos += chunk;
+    }
+    size_t total = head - _tail;
+    __atomic_store_n(&_tail, head, __ATOMIC_RELEASE);
+    return total;
+}
+
+void* CaptureWriter::writerMain(void* arg) {
+    CaptureWriter& self = *static_cast<CaptureWriter*>(arg);
+    for (;;) {
+        if (self.drain() != 0) continue;
+        // Same handshake as the logger: clear the flag, then look once more
+        // so a record published in between is not left waiting
+        __atomic_store_n(&self._wakePending, 0, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&self._head, __ATOMIC_ACQUIRE) != self._tail) continue;
+        if (!__atomic_load_n(&self._running, __ATOMIC_SEQ_CST)) return NULL;
+        struct pollfd pfd;
+        pfd.fd = self._wakeRead;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, -1);
+        char buf[64];
+        while (read(self._wakeRead, buf, sizeof(buf)) > 0) {}
+    }
+}
+
+CaptureReader::CaptureReader(const std::string& path) : _file(NULL), _timeNs(0) {
+    _file = std::fopen(path.c_str(), "rb");
+    if (_file == NULL) {
+        throw std::runtime_error("Failed to open capture file " + path + ": " + strerror(errno));
+    }
+    char magic[sizeof(MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), _file) != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        std::fclose(_file);
+        throw std::runtime_error(path + " is not a capture file");
+    }
+}
+
+CaptureReader::~CaptureReader() {
+    std::fclose(_file);
+}
+
+bool CaptureReader::readVarint(unsigned long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(_file);
+        if (c == EOF) return false;
+        value |= static_cast<unsigned long>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool CaptureReader::next(CaptureRecord& out) {
+    int kind = getc(_file);
+    if (kind == EOF) return false;
+    if (kind < CAPTURE_CONNECT || kind > CAPTURE_GAP) {
+        throw std::runtime_error("Corrupt capture record");
+    }
+    unsigned long delta, length = 0;
+    if (!readVarint(delta) || !readVarint(out.conn) || (kind == CAPTURE_LINE && !readVarint(length))) {
+        throw std::runtime_error("Truncated capture record");
+    }
+    if (length > MAX_RECORD_LINE) {
+        throw std::runtime_error("Corrupt capture record");
+    }
+    out.kind = static_cast<CaptureKind>(kind);
+    _timeNs += static_cast<long>(delta);
+    out.timeNs = _timeNs;
+    out.line.resize(length);
+    if (length > 0 && std::fread(&out.line[0], 1, length, _file) != length) {
+        throw std::runtime_error("Truncated capture record");
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <pthread.h>
+
+// Inbound traffic recording, for replaying production workloads offline
+// with bench/replay. The file is the 8-byte magic "IRCCAP1\n" followed by
+// records of
+//   kind (1 byte), time delta in ns since the previous record, connection
+//   id, and for CAPTURE_LINE the line length and bytes without CR/LF
+// where every number is an unsigned LEB128 varint. The first delta counts
+// from the start of the capture; connection ids are ClientInfo::id, never
+// reused within one run.
+enum CaptureKind {
+    CAPTURE_CONNECT = 1,
+    CAPTURE_LINE = 2,
+    CAPTURE_DISCONNECT = 3,
+    CAPTURE_GAP = 4                 // Records lost to a full ring; the id field holds their count
+};
+
+// Encodes records into a byte ring that a background thread writes to the
+// file, so the event loops never wait on the disk. Producers must hold the
+// server's state lock, which makes them a single producer; if the writer
+// falls behind by a whole ring, records are dropped and a CAPTURE_GAP
+// marks the spot.
+class CaptureWriter {
+public:
+    static const size_t RING_BYTES = 4 * 1024 * 1024;      // Power of two
+
+    // Creates or truncates path and starts the writer thread; throws
+    // std::runtime_error on failure
+    explicit CaptureWriter(const std::string& path);
+    // Writes out everything queued and joins the writer thread
+    ~CaptureWriter();
+
+    void connect(unsigned long conn) { record(CAPTURE_CONNECT, conn, NULL, 0); }
+    void line(unsigned long conn, const char* data, size_t len) { record(CAPTURE_LINE, conn, data, len); }
+    void disconnect(unsigned long conn) { record(CAPTURE_DISCONNECT, conn, NULL, 0); }
+
+    unsigned long records() const { return _records; }
+    unsigned long dropped() const { return _dropped; }
+
+private:
+    std::vector<char> _ring;
+    unsigned long _head;            // Bytes produced, published with release
+    unsigned long _tail;            // Bytes written out, published by the writer
+    long _lastNs;                   // Stamp of the previous record, producer only
+    unsigned long _records;
+    unsigned long _dropped;
+    unsigned long _gap;             // Dropped since the last record that fit
+    int _fd;
+    int _running;
+    int _wakePending;
+    int _wakeRead;
+    int _wakeWrite;
+    pthread_t _writer;
+
+    void record(CaptureKind kind, unsigned long conn, const char* data, size_t len);
+    bool append(CaptureKind kind, unsigned long conn, const char* data, size_t len, long now);
+    void copyIn(unsigned long pos, const char* data, size_t len);
+    size_t drain();
+    static void* writerMain(void* arg);
+
+    CaptureWriter(const CaptureWriter&);
+    CaptureWriter& operator=(const CaptureWriter&);
+};
+
+struct CaptureRecord {
+    CaptureKind kind;
+    long timeNs;                    // Since the start of the capture
+    unsigned long conn;             // Lost record count for CAPTURE_GAP
+    std::string line;
+};
+
+// Sequential reader for the format above
+class CaptureReader {
+public:
+    // Throws std::runtime_error when path cannot be opened or is not a capture
+    explicit CaptureReader(const std::string& path);
+    ~CaptureReader();
+
+    // False at the end of the file; throws std::runtime_error on a
+    // truncated or corrupt record
+    bool next(CaptureRecord& out);
+
+private:
+    std::FILE* _file;
+    long _timeNs;
+
+    bool readVarint(unsigned long& value);
+
+    CaptureReader(const CaptureReader&);
+    CaptureReader& operator=(const CaptureReader&);
+};
+
+#endif // CAPTURE_HPP
@@ -0,0 +1,156 @@
+#include "Channel.hpp"
+#include "parcer.hpp"
+#include <algorithm>
+
+std::string ChannelInfo::getModeString() const {
+    std::string modes = "+";
+    if (inviteOnly) modes += "i";
+    if (topicRestricted) modes += "t";
+    if (!key.empty()) modes += "k";
+    if (userLimit > 0) modes += "l";
+    return modes;
+}
+
+// Position of fd in the sorted member list, or where it would be inserted
+size_t ChannelInfo::memberSlot(int fd) const {
+    size_t lo = 0;
+    size_t hi = members.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (members[mid].fd < fd) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+ChannelMember* ChannelInfo::findMember(int fd) {
+    size_t i = memberSlot(fd);
+    return i < members.size() && members[i].fd == fd ? &members[i] : NULL;
+}
+
+bool ChannelInfo::hasMember(int fd) const {
+    size_t i = memberSlot(fd);
+    return i < members.size() && members[i].fd == fd;
+}
+
+bool ChannelInfo::isOperator(int fd) const {
+    size_t i = memberSlot(fd);
+    return i < members.size() && members[i].fd == fd && (members[i].modes & MEMBER_OP) != 0;
+}
+
+bool ChannelInfo::addMember(int fd, unsigned char modes) {
+    size_t i = memberSlot(fd);
+    if (i < members.size() && members[i].fd == fd) return false;
+    members.insert(members.begin() + i, ChannelMember(fd, modes));
+    invalidateNames();
+    return true;
+}
+
+bool ChannelInfo::removeMember(int fd) {
+    size_t i = memberSlot(fd);
+    if (i == members.size() || members[i].fd != fd) return false;
+    members.erase(members.begin() + i);
+    invalidateNames();
+    return true;
+}
+
+void ChannelInfo::setMemberMode(int fd, unsigned char mode, bool on) {
+    ChannelMember* member = findMember(fd);
+    if (member == NULL) return;
+    if (on) {
+        member->modes |= mode;
+    } else {
+        member->modes &= ~mode;
+    }
+    invalidateNames();
+}
+
+bool ChannelInfo::isInvited(int fd) const {
+    return std::binary_search(invited.begin(), invited.end(), fd);
+}
+
+void ChannelInfo::invite(int fd) {
+    std::vector<int>::iterator it = std::lower_bound(invited.begin(), invited.end(), fd);
+    if (it == invited.end() || *it != fd) invited.insert(it, fd);
+}
+
+void ChannelInfo::uninvite(int fd) {
+    std::vector<int>::iterator it = std::lower_bound(invited.begin(), invited.end(), fd);
+    if (it != invited.end() && *it == fd) invited.erase(it);
+}
+
+ChannelTable::ChannelTable(SymbolTable& symbols) : _symbols(symbols) {}
+
+ChannelTable::~ChannelTable() {
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        delete _slots[i];
+    }
+}
+
+ChannelInfo* ChannelTable::find(const char* name, size_t len) {
+    SymbolId symbol = _symbols.find(name, len);
+    return symbol < _byName.size() ? _byName[symbol] : NULL;
+}
+
+ChannelInfo& ChannelTable::create(const std::string& name) {
+    ChannelId id;
+    if (!_free.empty()) {
+        id = _free.back();
+        _free.pop_back();
+    } else {
+        id = static_cast<ChannelId>(_slots.size());
+        _slots.push_back(NULL);
+        _memberCounts.push_back(0);
+    }
+    ChannelInfo* channel = new ChannelInfo();
+    channel->id = id;
+    channel->nameId = _symbols.intern(name);
+    channel->name = name;
+    _slots[id] = channel;
+    if (_byName.size() <= channel->nameId) {
+        _byName.resize(channel->nameId + 1, static_cast<ChannelInfo*>(NULL));
+    }
+    _byName[channel->nameId] = channel;
+    return *channel;
+}
+
+void ChannelTable::destroy(ChannelId id) {
+    ChannelInfo* channel = get(id);
+    if (channel == NULL) return;
+    _byName[channel->nameId] = NULL;
+    _symbols.release(channel->nameId);
+    delete channel;
+    _slots[id] = NULL;
+    _memberCounts[id] = 0;
+    _free.push_back(id);
+}
+
+void ChannelFilter::addCondition(const std::string& condition) {
+    if (condition[0] == '>' || condition[0] == '<') {
+        int n;
+        if (!stringToInt(condition.substr(1), n) || n < 0) return;
+        if (condition[0] == '>') {
+            minMembers = static_cast<size_t>(n) + 1;
+        } else {
+            maxMembers = n == 0 ? 0 : static_cast<size_t>(n) - 1;
+        }
+    } else if (condition[0] == '!') {
+        excludes.push_back(condition.substr(1));
+    } else {
+        masks.push_back(condition);
+    }
+}
+
+bool ChannelFilter::matchesName(const std::string& name) const {
+    for (size_t i = 0; i < excludes.size(); ++i) {
+        if (matchMask(excludes[i], name)) return false;
+    }
+    if (masks.empty()) return true;
+    for (size_t i = 0; i < masks.size(); ++i) {
+        if (matchMask(masks[i], name)) return true;
+    }
+    return false;
+}
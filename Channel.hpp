@@ -0,0 +1,112 @@
+#ifndef CHANNEL_HPP
+#define CHANNEL_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "SymbolTable.hpp"
+
+typedef unsigned int ChannelId;
+
+// Per-member channel modes, kept next to the fd so one pass over the member
+// list has everything NAMES, broadcasts and privilege checks need
+enum {
+    MEMBER_OP = 1,                  // +o
+    MEMBER_VOICE = 2                // +v
+};
+
+struct ChannelMember {
+    int fd;
+    unsigned char modes;            // MEMBER_* bits
+
+    ChannelMember(int f, unsigned char m) : fd(f), modes(m) {}
+};
+
+struct ChannelInfo {
+    ChannelId id;                   // Slot in the server's ChannelTable
+    SymbolId nameId;                // Interned name
+    std::string name;               // As spelled by the client that created it
+    std::vector<ChannelMember> members; // Sorted by fd
+    std::vector<int> invited;       // Invited client fds (for +i mode), sorted
+    std::string key;                // Channel password
+    size_t userLimit;               // 0 means no limit
+    bool inviteOnly;                // +i mode
+    bool topicRestricted;           // +t mode
+    std::string topic;              // Channel topic
+    std::string names;              // NAMES list ("@op voiced ..."), valid while namesValid
+    bool namesValid;
+
+    ChannelInfo() : id(0), nameId(NO_SYMBOL), userLimit(0), inviteOnly(false), topicRestricted(true), namesValid(false) {}
+
+    std::string getModeString() const;
+
+    ChannelMember* findMember(int fd);
+    bool hasMember(int fd) const;
+    bool isOperator(int fd) const;
+    bool addMember(int fd, unsigned char modes);    // false if already a member
+    bool removeMember(int fd);
+    void setMemberMode(int fd, unsigned char mode, bool on);
+    // Membership and mode changes call this; so must a member's nick change
+    void invalidateNames() { namesValid = false; }
+    // Index of the first member whose fd is not below fd
+    size_t memberSlot(int fd) const;
+
+    bool isInvited(int fd) const;
+    void invite(int fd);
+    void uninvite(int fd);
+};
+
+// LIST conditions (ELIST M, N and U): ">N" and "<N" bound the member
+// count, "!mask" excludes names, any other token is a mask of which at
+// least one must match. No conditions lists everything.
+struct ChannelFilter {
+    size_t minMembers;
+    size_t maxMembers;
+    std::vector<std::string> masks;
+    std::vector<std::string> excludes;
+
+    ChannelFilter() : minMembers(0), maxMembers(static_cast<size_t>(-1)) {}
+
+    void addCondition(const std::string& condition);   // Bad numbers are ignored
+    bool matchesCount(size_t members) const { return members >= minMembers && members <= maxMembers; }
+    bool matchesName(const std::string& name) const;
+};
+
+// Owns every channel: channels are addressed by a small integer id, and
+// names resolve through the shared symbol table to a table indexed by
+// SymbolId. Ids of destroyed channels are reused, so an id is only
+// meaningful while the channel exists.
+class ChannelTable {
+public:
+    explicit ChannelTable(SymbolTable& symbols);
+    ~ChannelTable();
+
+    ChannelInfo* find(const char* name, size_t len);
+    ChannelInfo* find(const std::string& name) { return find(name.data(), name.length()); }
+    ChannelInfo* get(ChannelId id) { return id < _slots.size() ? _slots[id] : NULL; }
+    ChannelInfo& create(const std::string& name);   // Caller checked it does not exist
+    void destroy(ChannelId id);
+    // Member counts by id, 0 for free ids, kept dense so a filtered LIST
+    // can skip channels without touching them. Server::joinChannel and
+    // leaveChannel keep it current.
+    size_t memberCount(ChannelId id) const { return id < _memberCounts.size() ? _memberCounts[id] : 0; }
+    void updateMemberCount(const ChannelInfo& channel) {
+        _memberCounts[channel.id] = static_cast<unsigned int>(channel.members.size());
+    }
+
+    size_t size() const { return _slots.size() - _free.size(); }
+    // Upper bound on ids, for iterating with get()
+    ChannelId idLimit() const { return static_cast<ChannelId>(_slots.size()); }
+
+private:
+    std::vector<ChannelInfo*> _slots;
+    std::vector<ChannelId> _free;
+    SymbolTable& _symbols;
+    std::vector<ChannelInfo*> _byName;      // SymbolId -> channel
+    std::vector<unsigned int> _memberCounts;
+
+    ChannelTable(const ChannelTable&);
+    ChannelTable& operator=(const ChannelTable&);
+};
+
+#endif // CHANNEL_HPP
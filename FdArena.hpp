@@ -0,0 +1,80 @@
+#ifndef FDARENA_HPP
+#define FDARENA_HPP
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+// Object storage indexed by file descriptor. Objects live in fixed-size
+// chunks of contiguous slots, so neighbouring fds are neighbours in memory,
+// lookup is two array indexes, and an object never moves once constructed
+// (pointers to it stay valid until release). Chunks are allocated on first
+// use and kept for reuse.
+template <typename T, size_t CHUNK_SIZE = 256>
+class FdArena {
+public:
+    FdArena() : _count(0) {}
+
+    ~FdArena() {
+        for (size_t c = 0; c < _chunks.size(); ++c) {
+            for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+                if (_chunks[c]->used[i]) _chunks[c]->at(i)->~T();
+            }
+            ::operator delete(_chunks[c]->storage);
+            delete _chunks[c];
+        }
+    }
+
+    // NULL when no object is stored under fd
+    T* find(int fd) const {
+        if (fd < 0) return NULL;
+        size_t c = static_cast<size_t>(fd) / CHUNK_SIZE;
+        size_t i = static_cast<size_t>(fd) % CHUNK_SIZE;
+        if (c >= _chunks.size() || !_chunks[c]->used[i]) return NULL;
+        return _chunks[c]->at(i);
+    }
+
+    // Constructs T(fd) in the slot for fd, which must be free
+    T& acquire(int fd) {
+        size_t c = static_cast<size_t>(fd) / CHUNK_SIZE;
+        size_t i = static_cast<size_t>(fd) % CHUNK_SIZE;
+        while (_chunks.size() <= c) {
+            _chunks.push_back(new Chunk());
+        }
+        T* slot = new (_chunks[c]->at(i)) T(fd);
+        _chunks[c]->used[i] = true;
+        ++_count;
+        return *slot;
+    }
+
+    void release(int fd) {
+        T* object = find(fd);
+        if (object == NULL) return;
+        object->~T();
+        _chunks[fd / CHUNK_SIZE]->used[fd % CHUNK_SIZE] = false;
+        --_count;
+    }
+
+    size_t size() const { return _count; }
+    // Upper bound on fds, for iterating with find()
+    int fdLimit() const { return static_cast<int>(_chunks.size() * CHUNK_SIZE); }
+
+private:
+    struct Chunk {
+        void* storage;
+        bool used[CHUNK_SIZE];
+
+        Chunk() : storage(::operator new(sizeof(T) * CHUNK_SIZE)) {
+            for (size_t i = 0; i < CHUNK_SIZE; ++i) used[i] = false;
+        }
+        T* at(size_t i) { return static_cast<T*>(storage) + i; }
+    };
+
+    std::vector<Chunk*> _chunks;
+    size_t _count;
+
+    FdArena(const FdArena&);
+    FdArena& operator=(const FdArena&);
+};
+
+#endif // FDARENA_HPP
@@ -0,0 +1,100 @@
+#ifndef FDTABLE_HPP
+#define FDTABLE_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Dense table keyed by file descriptor. The kernel hands out the lowest free
+// fd, so a vector indexed by fd stays compact and lookup, insert and erase
+// are all O(1). Each slot carries a generation that changes whenever the fd
+// is released, so a saved (fd, generation) pair can tell a reused descriptor
+// from the connection it was taken for.
+template <typename T>
+class FdTable {
+public:
+    FdTable() : _count(0) {}
+
+    // NULL when nothing is stored under fd
+    T* find(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) >= _slots.size()) return NULL;
+        return _slots[fd].value;
+    }
+
+    // NULL unless fd still holds the entry that had this generation
+    T* find(int fd, unsigned int generation) const {
+        T* value = find(fd);
+        return value != NULL && _slots[fd].generation == generation ? value : NULL;
+    }
+
+    unsigned int generation(int fd) const {
+        return static_cast<size_t>(fd) < _slots.size() ? _slots[fd].generation : 0;
+    }
+
+    void insert(int fd, T* value) {
+        if (static_cast<size_t>(fd) >= _slots.size()) {
+            _slots.resize(fd + 1);
+        }
+        if (_slots[fd].value == NULL) ++_count;
+        _slots[fd].value = value;
+    }
+
+    void erase(int fd) {
+        if (find(fd) == NULL) return;
+        _slots[fd].value = NULL;
+        ++_slots[fd].generation;
+        --_count;
+    }
+
+    size_t size() const { return _count; }
+
+private:
+    struct Slot {
+        T* value;
+        unsigned int generation;
+
+        Slot() : value(NULL), generation(0) {}
+    };
+
+    std::vector<Slot> _slots;
+    size_t _count;
+};
+
+// An fd captured together with its generation, for deferred work lists
+struct FdRef {
+    int fd;
+    unsigned int generation;
+
+    FdRef(int f, unsigned int gen) : fd(f), generation(gen) {}
+};
+
+// FIFO of FdRefs over a single vector, for round-robin work lists. Popped
+// slots are reclaimed by shifting the live tail down, so a queue that is
+// busy but bounded stops allocating (std::deque frees and reallocates its
+// blocks as the queue moves).
+class FdQueue {
+public:
+    FdQueue() : _head(0) {}
+
+    bool empty() const { return _head == _items.size(); }
+    size_t size() const { return _items.size() - _head; }
+    const FdRef& operator[](size_t i) const { return _items[_head + i]; }
+
+    void push(const FdRef& ref) { _items.push_back(ref); }
+    FdRef pop() {
+        FdRef ref = _items[_head++];
+        if (_head == _items.size()) {
+            _items.clear();
+            _head = 0;
+        } else if (_head >= 64 && _head * 2 >= _items.size()) {
+            _items.erase(_items.begin(), _items.begin() + _head);
+            _head = 0;
+        }
+        return ref;
+    }
+
+private:
+    std::vector<FdRef> _items;
+    size_t _head;
+};
+
+#endif // FDTABLE_HPP
@@ -0,0 +1,27 @@
+#include "InputBuffer.hpp"
+
+void InputBuffer::append(const char* bytes, size_t n) {
+    // Drop the consumed prefix first. What is left are the lines not yet
+    // dispatched: complete lines held back by the turn quota, flood control
+    // or a running task, plus at most one partial tail. The event loop only
+    // reads again once held lines are gone, so there the move is bounded by
+    // the maximum line length; offline feedInput may move more.
+    if (_start > 0) {
+        _data.erase(_data.begin(), _data.begin() + _start);
+        _start = 0;
+    }
+    _data.insert(_data.end(), bytes, bytes + n);
+}
+
+void InputBuffer::consume(size_t n) {
+    _start += n;
+    if (_start >= _data.size()) {
+        clear();
+    }
+}
+
+void InputBuffer::clear() {
+    // Keeps the capacity, a client that needed it once will likely need it again
+    _data.clear();
+    _start = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef INPUTBUFFER_HPP
+#define INPUTBUFFER_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Holds a client's undispatched input between reads: complete lines held
+// back while the client waits its turn, and the unterminated tail. Consumed
+// lines only advance a read cursor; the remaining bytes are moved to the
+// front lazily, once per append, so framing stays linear in the input size
+// no matter how many lines arrive in one packet.
+class InputBuffer {
+public:
+    InputBuffer() : _start(0) {}
+
+    bool empty() const { return _start == _data.size(); }
+    size_t size() const { return _data.size() - _start; }
+    const char* data() const { return _data.empty() ? NULL : &_data[0] + _start; }
+
+    void append(const char* bytes, size_t n);
+    void consume(size_t n);
+    void clear();
+
+private:
+    std::vector<char> _data;
+    size_t _start;                  // Read cursor, bytes before it are consumed
+};
+
+#endif // INPUTBUFFER_HPP
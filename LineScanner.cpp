@@ -0,0 +1,122 @@
+#include "LineScanner.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+# if defined(__GNUC__) && defined(__SSE2__)
+#  define IRC_SCAN_SSE2 1
+#  include <emmintrin.h>
+# endif
+# if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5)
+#  define IRC_SCAN_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+
+size_t scanLineScalar(const char* data, size_t len, bool& hasNul) {
+    hasNul = false;
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (c == '\n') return i;
+        if (c == '\0') hasNul = true;
+    }
+    return len;
+}
+
+// Resolves a block hit: the newline at 'bit', plus any NUL below it
+static inline size_t blockHit(size_t base, unsigned int newlines, unsigned int nuls, bool& hasNul) {
+    unsigned int bit = __builtin_ctz(newlines);
+    if (nuls & ((1u << bit) - 1)) hasNul = true;
+    return base + bit;
+}
+
+#ifdef IRC_SCAN_SSE2
+
+size_t scanLineSse2(const char* data, size_t len, bool& hasNul) {
+    hasNul = false;
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned int newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        unsigned int nuls = _mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+        if (newlines) return blockHit(i, newlines, nuls, hasNul);
+        if (nuls) hasNul = true;
+    }
+    bool tailNul;
+    size_t end = i + scanLineScalar(data + i, len - i, tailNul);
+    hasNul = hasNul || tailNul;
+    return end;
+}
+
+#else
+
+size_t scanLineSse2(const char* data, size_t len, bool& hasNul) {
+    return scanLineScalar(data, len, hasNul);
+}
+
+#endif
+
+#ifdef IRC_SCAN_AVX2
+
+__attribute__((target("avx2")))
+size_t scanLineAvx2(const char* data, size_t len, bool& hasNul) {
+    hasNul = false;
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        unsigned int newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        unsigned int nuls = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero));
+        if (newlines) return blockHit(i, newlines, nuls, hasNul);
+        if (nuls) hasNul = true;
+    }
+    bool tailNul;
+    size_t end = i + scanLineSse2(data + i, len - i, tailNul);
+    hasNul = hasNul || tailNul;
+    return end;
+}
+
+#else
+
+size_t scanLineAvx2(const char* data, size_t len, bool& hasNul) {
+    return scanLineSse2(data, len, hasNul);
+}
+
+#endif
+
+typedef size_t (*ScanFunction)(const char*, size_t, bool&);
+
+struct ScannerChoice {
+    ScanFunction fn;
+    const char* name;
+};
+
+static ScannerChoice pickScanner() {
+    ScannerChoice choice;
+    choice.fn = scanLineScalar;
+    choice.name = "scalar";
+#ifdef IRC_SCAN_SSE2
+    choice.fn = scanLineSse2;
+    choice.name = "sse2";
+#endif
+#ifdef IRC_SCAN_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        choice.fn = scanLineAvx2;
+        choice.name = "avx2";
+    }
+#endif
+    return choice;
+}
+
+// Chosen once during static initialization, before the server starts
+static const ScannerChoice g_scanner = pickScanner();
+
+size_t scanLine(const char* data, size_t len, bool& hasNul) {
+    return g_scanner.fn(data, len, hasNul);
+}
+
+const char* lineScannerName() {
+    return g_scanner.name;
+}
@@ -0,0 +1,21 @@
+#ifndef LINESCANNER_HPP
+#define LINESCANNER_HPP
+
+#include <cstddef>
+
+// Finds the first '\n' in data[0, len) and, in the same pass, whether a NUL
+// byte (forbidden in IRC lines) occurs before it. Returns the offset of the
+// newline, or len when there is none; hasNul covers the scanned range only.
+// Dispatches to the widest vector unit the CPU offers (AVX2, SSE2, scalar).
+size_t scanLine(const char* data, size_t len, bool& hasNul);
+
+// Name of the variant scanLine dispatches to
+const char* lineScannerName();
+
+// Individual variants, exposed for the microbenchmark. The vector ones fall
+// back to scalar when the build or the CPU lacks the instruction set.
+size_t scanLineScalar(const char* data, size_t len, bool& hasNul);
+size_t scanLineSse2(const char* data, size_t len, bool& hasNul);
+size_t scanLineAvx2(const char* data, size_t len, bool& hasNul);
+
+#endif // LINESCANNER_HPP
@@ -0,0 +1,299 @@
+#include "Logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace {
+
+const size_t RING_SLOTS = 2048;             // Power of two
+const size_t WRITE_BATCH = 64;              // Lines per writev()
+
+struct LogSlot {
+    unsigned long sequence;                 // Slot state, see enqueue/dequeue
+    LogLevel level;
+    long stampMs;                           // Wall clock, taken by the caller
+    size_t length;
+    char text[Logger::MAX_LINE + 1];        // Room for the newline
+};
+
+LogSlot s_ring[RING_SLOTS];
+unsigned long s_enqueuePos = 0;             // Producers, CAS
+unsigned long s_dequeuePos = 0;             // Writer thread only
+unsigned long s_dropped = 0;
+int s_started = 0;
+int s_running = 0;
+int s_wakePending = 0;
+int s_wakeRead = -1;
+int s_wakeWrite = -1;
+pthread_t s_writer;
+
+const char* const LEVEL_NAMES[] = { "ERROR", "WARN ", "INFO ", "DEBUG" };
+
+long wallClockMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+int levelFd(LogLevel level) {
+    return level <= LOG_LEVEL_WARN ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+// "HH:MM:SS.mmm LEVEL ", UTC
+size_t formatPrefix(char* out, long stampMs, LogLevel level) {
+    time_t seconds = static_cast<time_t>(stampMs / 1000);
+    struct tm parts;
+    gmtime_r(&seconds, &parts);
+    int ms = static_cast<int>(stampMs % 1000);
+    const int fields[] = { parts.tm_hour, parts.tm_min, parts.tm_sec };
+    size_t n = 0;
+    for (int i = 0; i < 3; ++i) {
+        out[n++] = static_cast<char>('0' + fields[i] / 10);
+        out[n++] = static_cast<char>('0' + fields[i] % 10);
+        out[n++] = i < 2 ? ':' : '.';
+    }
+    out[n++] = static_cast<char>('0' + ms / 100);
+    out[n++] = static_cast<char>('0' + ms / 10 % 10);
+    out[n++] = static_cast<char>('0' + ms % 10);
+    out[n++] = ' ';
+    std::memcpy(out + n, LEVEL_NAMES[level], 5);
+    n += 5;
+    out[n++] = ' ';
+    return n;
+}
+
+// Writes all of iov, retrying short writes. Errors lose the batch: logging
+// must never take the server down with it.
+void writeAll(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        size_t left = static_cast<size_t>(n);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+bool slotReady(unsigned long pos) {
+    return __atomic_load_n(&s_ring[pos % RING_SLOTS].sequence, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+// Writes out finished slots in order, one writev per run of lines bound
+// for the same stream, and hands the slots back to producers. Only one
+// thread may drain at a time. Returns the number of lines written.
+size_t drain() {
+    size_t total = 0;
+    char prefixes[WRITE_BATCH][24];
+    struct iovec iov[WRITE_BATCH * 2];
+    for (;;) {
+        unsigned long first = s_dequeuePos;
+        size_t count = 0;
+        int fd = -1;
+        while (count < WRITE_BATCH && slotReady(first + count)) {
+            LogSlot& slot = s_ring[(first + count) % RING_SLOTS];
+            if (fd != -1 && levelFd(slot.level) != fd) break;
+            fd = levelFd(slot.level);
+            iov[count * 2].iov_base = prefixes[count];
+            iov[count * 2].iov_len = formatPrefix(prefixes[count], slot.stampMs, slot.level);
+            iov[count * 2 + 1].iov_base = slot.text;
+            iov[count * 2 + 1].iov_len = slot.length;
+            ++count;
+        }
+        if (count == 0) return total;
+        writeAll(fd, iov, static_cast<int>(count * 2));
+        for (size_t i = 0; i < count; ++i) {
+            __atomic_store_n(&s_ring[(first + i) % RING_SLOTS].sequence, first + i + RING_SLOTS, __ATOMIC_RELEASE);
+        }
+        s_dequeuePos = first + count;
+        total += count;
+    }
+}
+
+void* writerMain(void*) {
+    for (;;) {
+        if (drain() != 0) continue;
+        // Producers wake us only while the flag is clear; clear it, then
+        // look once more so a line queued in between is not left waiting
+        __atomic_store_n(&s_wakePending, 0, __ATOMIC_SEQ_CST);
+        if (slotReady(s_dequeuePos)) continue;
+        if (!__atomic_load_n(&s_running, __ATOMIC_SEQ_CST)) return NULL;
+        struct pollfd pfd;
+        pfd.fd = s_wakeRead;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, -1);
+        char buf[64];
+        while (read(s_wakeRead, buf, sizeof(buf)) > 0) {}
+    }
+}
+
+void wakeWriter() {
+    if (__atomic_exchange_n(&s_wakePending, 1, __ATOMIC_SEQ_CST) == 0) {
+        char byte = 1;
+        ssize_t ignored = write(s_wakeWrite, &byte, 1);
+        (void)ignored;
+    }
+}
+
+} // namespace
+
+LogLevel Logger::s_level = LOG_LEVEL_INFO;
+
+void Logger::start(LogLevel level) {
+    s_level = level;
+    if (s_started) return;
+    for (size_t i = 0; i < RING_SLOTS; ++i) {
+        s_ring[i].sequence = i;
+    }
+    int fds[2];
+    if (pipe(fds) < 0) return;              // Stay synchronous
+    s_wakeRead = fds[0];
+    s_wakeWrite = fds[1];
+    fcntl(s_wakeRead, F_SETFL, O_NONBLOCK);
+    fcntl(s_wakeWrite, F_SETFL, O_NONBLOCK);
+    __atomic_store_n(&s_running, 1, __ATOMIC_SEQ_CST);
+    if (pthread_create(&s_writer, NULL, writerMain, NULL) != 0) {
+        close(s_wakeRead);
+        close(s_wakeWrite);
+        return;
+    }
+    __atomic_store_n(&s_started, 1, __ATOMIC_RELEASE);
+}
+
+void Logger::stop() {
+    if (!__atomic_load_n(&s_started, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&s_running, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&s_wakePending, 1, __ATOMIC_SEQ_CST);
+    char byte = 1;
+    ssize_t ignored = write(s_wakeWrite, &byte, 1);
+    (void)ignored;
+    pthread_join(s_writer, NULL);
+    __atomic_store_n(&s_started, 0, __ATOMIC_RELEASE);
+    // Lines that raced with the shutdown
+    drain();
+    close(s_wakeRead);
+    close(s_wakeWrite);
+}
+
+void Logger::submit(LogLevel level, const char* text, size_t length) {
+    if (length > MAX_LINE) length = MAX_LINE;
+    long stamp = wallClockMs();
+    if (!__atomic_load_n(&s_started, __ATOMIC_ACQUIRE)) {
+        char prefix[24];
+        char newline = '\n';
+        struct iovec iov[3];
+        iov[0].iov_base = prefix;
+        iov[0].iov_len = formatPrefix(prefix, stamp, level);
+        iov[1].iov_base = const_cast<char*>(text);
+        iov[1].iov_len = length;
+        iov[2].iov_base = &newline;
+        iov[2].iov_len = 1;
+        writeAll(levelFd(level), iov, 3);
+        return;
+    }
+
+    // Claim the slot at the enqueue position once the writer has freed it
+    unsigned long pos = __atomic_load_n(&s_enqueuePos, __ATOMIC_RELAXED);
+    LogSlot* slot;
+    for (;;) {
+        slot = &s_ring[pos % RING_SLOTS];
+        unsigned long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(sequence - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&s_enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_add_fetch(&s_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&s_enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->level = level;
+    slot->stampMs = stamp;
+    std::memcpy(slot->text, text, length);
+    slot->text[length] = '\n';
+    slot->length = length + 1;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    wakeWriter();
+}
+
+unsigned long Logger::dropped() {
+    return __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    static const char* const names[] = { "error", "warn", "info", "debug" };
+    for (int i = 0; i < 4; ++i) {
+        if (name == names[i]) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+LogLine& LogLine::append(const char* data, size_t length) {
+    size_t room = Logger::MAX_LINE - _length;
+    if (length > room) length = room;
+    std::memcpy(_text + _length, data, length);
+    _length += length;
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const char* s) {
+    return append(s, std::strlen(s));
+}
+
+LogLine& LogLine::operator<<(long n) {
+    if (n < 0) {
+        *this << '-';
+        return *this << static_cast<unsigned long>(-(n + 1)) + 1;
+    }
+    return *this << static_cast<unsigned long>(n);
+}
+
+LogLine& LogLine::operator<<(unsigned long n) {
+    char digits[24];
+    size_t count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    return append(digits + sizeof(digits) - count, count);
+}
+
+bool LogLimiter::allow(long nowMs) {
+    if (nowMs - _windowStart >= 1000) {
+        _windowStart = nowMs;
+        _lines = 0;
+    }
+    if (_lines < LINES_PER_SECOND) {
+        ++_lines;
+        return true;
+    }
+    ++_suppressed;
+    return false;
+}
+
+unsigned long LogLimiter::takeSuppressed() {
+    unsigned long count = _suppressed;
+    _suppressed = 0;
+    return count;
+}
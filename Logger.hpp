@@ -0,0 +1,144 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <cstddef>
+
+// Severity, most severe first. ERROR and WARN go to stderr, the rest to stdout.
+enum LogLevel {
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3
+};
+
+// Levels above this are compiled out entirely: `make LOG_LEVEL=2` removes
+// every LOG_DEBUG call, arguments included
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 3
+#endif
+
+// Asynchronous log sink. Callers format into a LogLine on their own stack
+// and copy it into a bounded lock-free ring (Vyukov's sequence-numbered
+// slots); a writer thread hands batches of finished slots to writev(). A
+// caller never blocks on the log: if the output stalls and the ring fills,
+// lines are dropped and counted. Before start() and after stop() lines are
+// written synchronously.
+class Logger {
+public:
+    static const size_t MAX_LINE = 640;     // Longer lines are cut
+
+    static void start(LogLevel level);
+    // Writes out everything queued and joins the writer thread
+    static void stop();
+
+    static bool enabled(LogLevel level) { return level <= s_level; }
+    static void submit(LogLevel level, const char* text, size_t length);
+    // Lines lost to a full ring
+    static unsigned long dropped();
+    static bool parseLevel(const std::string& name, LogLevel& level);
+
+private:
+    static LogLevel s_level;
+};
+
+// Raw bytes for a LogLine, e.g. an input line that is not NUL-terminated
+struct LogText {
+    const char* data;
+    size_t length;
+
+    LogText(const char* d, size_t n) : data(d), length(n) {}
+};
+
+// Formats one log line without allocating; the destructor submits it, so
+// `LogLine(LOG_LEVEL_INFO) << "fd " << fd;` logs one line
+class LogLine {
+public:
+    explicit LogLine(LogLevel level) : _level(level), _length(0) {}
+    ~LogLine() { Logger::submit(_level, _text, _length); }
+
+    LogLine& operator<<(const char* s);
+    LogLine& operator<<(const std::string& s) { return append(s.data(), s.length()); }
+    LogLine& operator<<(char c) { return append(&c, 1); }
+    LogLine& operator<<(int n) { return *this << static_cast<long>(n); }
+    LogLine& operator<<(unsigned int n) { return *this << static_cast<unsigned long>(n); }
+    LogLine& operator<<(long n);
+    LogLine& operator<<(unsigned long n);
+    LogLine& operator<<(const LogText& text) { return append(text.data, text.length); }
+    LogLine& append(const char* data, size_t length);
+
+private:
+    LogLevel _level;
+    size_t _length;
+    char _text[Logger::MAX_LINE];
+
+    LogLine(const LogLine&);
+    LogLine& operator=(const LogLine&);
+};
+
+// Caps per-client debug tracing at LINES_PER_SECOND, so one chatty client
+// cannot fill the ring for everyone. Lines over the cap are only counted,
+// and the count is reported with the next line that gets through.
+class LogLimiter {
+public:
+    static const unsigned int LINES_PER_SECOND = 20;
+
+    LogLimiter() : _windowStart(0), _lines(0), _suppressed(0) {}
+
+    bool allow(long nowMs);
+    // Suppressed lines since the last call
+    unsigned long takeSuppressed();
+
+private:
+    long _windowStart;              // Monotonic ms the current second began
+    unsigned int _lines;
+    unsigned long _suppressed;
+};
+
+#define IRC_LOG(level, expr) \
+    do { \
+        if (Logger::enabled(level)) { \
+            LogLine(level) << expr; \
+        } \
+    } while (0)
+
+// Still type-checks the call, and keeps its variables "used", but the
+// constant condition leaves no code behind
+#define IRC_LOG_DISABLED(level, expr) \
+    do { \
+        if (0) { \
+            LogLine(level) << expr; \
+        } \
+    } while (0)
+
+#define LOG_ERROR(expr) IRC_LOG(LOG_LEVEL_ERROR, expr)
+#if LOG_COMPILED_LEVEL >= 1
+#define LOG_WARN(expr) IRC_LOG(LOG_LEVEL_WARN, expr)
+#else
+#define LOG_WARN(expr) IRC_LOG_DISABLED(LOG_LEVEL_WARN, expr)
+#endif
+#if LOG_COMPILED_LEVEL >= 2
+#define LOG_INFO(expr) IRC_LOG(LOG_LEVEL_INFO, expr)
+#else
+#define LOG_INFO(expr) IRC_LOG_DISABLED(LOG_LEVEL_INFO, expr)
+#endif
+#if LOG_COMPILED_LEVEL >= 3
+#define LOG_DEBUG(expr) IRC_LOG(LOG_LEVEL_DEBUG, expr)
+// Debug line about one client, rate-limited through its LogLimiter
+#define LOG_CLIENT_DEBUG(limiter, nowMs, expr) \
+    do { \
+        if (Logger::enabled(LOG_LEVEL_DEBUG) && (limiter).allow(nowMs)) { \
+            LogLine logLine(LOG_LEVEL_DEBUG); \
+            unsigned long logSkipped = (limiter).takeSuppressed(); \
+            if (logSkipped != 0) { \
+                logLine << "(" << logSkipped << " lines suppressed) "; \
+            } \
+            logLine << expr; \
+        } \
+    } while (0)
+#else
+#define LOG_DEBUG(expr) IRC_LOG_DISABLED(LOG_LEVEL_DEBUG, expr)
+#define LOG_CLIENT_DEBUG(limiter, nowMs, expr) IRC_LOG_DISABLED(LOG_LEVEL_DEBUG, expr)
+#endif
+
+#endif // LOGGER_HPP
@@ -0,0 +1,180 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <sstream>
+
+static const char* const DISCONNECT_NAMES[DISCONNECT_COUNT] = {
+    "quit", "eof", "read_error", "write_error", "sendq", "ping_timeout", "registration_timeout", "other"
+};
+
+const char* disconnectReasonName(DisconnectReason reason) {
+    return DISCONNECT_NAMES[reason];
+}
+
+Histogram::Histogram() : _count(0), _sum(0), _max(0) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        _buckets[i] = 0;
+    }
+}
+
+size_t Histogram::bucketOf(unsigned long value) {
+    if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+    int msb = 63 - __builtin_clzl(value);
+    size_t group = static_cast<size_t>(msb - SUB_BITS + 1);
+    size_t bucket = group * SUB_BUCKETS + ((value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+    return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+unsigned long Histogram::bucketUpper(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket + 1;
+    size_t shift = bucket / SUB_BUCKETS - 1;
+    unsigned long lower = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lower + (1UL << shift);
+}
+
+void Histogram::record(unsigned long value) {
+    bumpCounter(_buckets[bucketOf(value)]);
+    bumpCounter(_count);
+    bumpCounter(_sum, value);
+    if (value > readCounter(_max)) {
+        __atomic_store_n(&_max, value, __ATOMIC_RELAXED);
+    }
+}
+
+void Histogram::addTo(Histogram& total) const {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        total._buckets[i] += readCounter(_buckets[i]);
+    }
+    total._count += readCounter(_count);
+    total._sum += readCounter(_sum);
+    unsigned long max = readCounter(_max);
+    if (max > total._max) total._max = max;
+}
+
+unsigned long Histogram::quantile(double q) const {
+    unsigned long total = count();
+    if (total == 0) return 0;
+    unsigned long rank = static_cast<unsigned long>(q * static_cast<double>(total - 1)) + 1;
+    unsigned long seen = 0;
+    size_t i = 0;
+    for (; i + 1 < BUCKETS; ++i) {
+        seen += readCounter(_buckets[i]);
+        if (seen >= rank) break;
+    }
+    // A bucket's upper edge can lie above every value recorded in it
+    return std::min(bucketUpper(i), max());
+}
+
+unsigned long Histogram::countBelow(unsigned long limit) const {
+    unsigned long seen = 0;
+    for (size_t i = 0; i < BUCKETS && bucketUpper(i) <= limit; ++i) {
+        seen += readCounter(_buckets[i]);
+    }
+    return seen;
+}
+
+ReactorMetrics::ReactorMetrics(size_t commandSlots)
+    : accepts(0), bytesIn(0), bytesOut(0), messagesOut(0), sendqBytes(0), lockWaits(0), lockWaitNs(0),
+      commands(commandSlots, 0), latency(commandSlots) {
+    for (size_t i = 0; i < DISCONNECT_COUNT; ++i) {
+        disconnects[i] = 0;
+    }
+}
+
+void ReactorMetrics::adjustSendq(size_t before, size_t after) {
+    unsigned long current = readCounter(sendqBytes);
+    if (after >= before) {
+        current += after - before;
+    } else {
+        current = current > before - after ? current - (before - after) : 0;
+    }
+    __atomic_store_n(&sendqBytes, current, __ATOMIC_RELAXED);
+}
+
+MetricsSnapshot::MetricsSnapshot()
+    : accepts(0), bytesIn(0), bytesOut(0), messagesOut(0), sendqBytes(0), lockWaits(0), lockWaitNs(0),
+      clients(0), channels(0),
+      throttleEvents(0), throttledClients(0), logDropped(0), uptimeSeconds(0) {
+    for (size_t i = 0; i < DISCONNECT_COUNT; ++i) {
+        disconnects[i] = 0;
+    }
+}
+
+void MetricsSnapshot::add(const ReactorMetrics& reactor) {
+    accepts += readCounter(reactor.accepts);
+    bytesIn += readCounter(reactor.bytesIn);
+    bytesOut += readCounter(reactor.bytesOut);
+    messagesOut += readCounter(reactor.messagesOut);
+    sendqBytes += readCounter(reactor.sendqBytes);
+    lockWaits += readCounter(reactor.lockWaits);
+    lockWaitNs += readCounter(reactor.lockWaitNs);
+    for (size_t i = 0; i < DISCONNECT_COUNT; ++i) {
+        disconnects[i] += readCounter(reactor.disconnects[i]);
+    }
+    if (commands.size() < reactor.commands.size()) {
+        commands.resize(reactor.commands.size(), 0);
+        latency.resize(reactor.latency.size());
+    }
+    for (size_t i = 0; i < reactor.commands.size(); ++i) {
+        commands[i] += readCounter(reactor.commands[i]);
+        reactor.latency[i].addTo(latency[i]);
+    }
+}
+
+static void writeMetric(std::ostringstream& out, const char* name, const char* type, const char* help,
+                        unsigned long value) {
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << ' ' << type << '\n'
+        << name << ' ' << value << '\n';
+}
+
+void MetricsSnapshot::writePrometheus(std::string& text) const {
+    std::ostringstream out;
+    writeMetric(out, "ircserv_uptime_seconds", "gauge", "Seconds since the server started.", uptimeSeconds);
+    writeMetric(out, "ircserv_clients", "gauge", "Connected clients.", clients);
+    writeMetric(out, "ircserv_channels", "gauge", "Existing channels.", channels);
+    writeMetric(out, "ircserv_connections_accepted_total", "counter", "Connections accepted.", accepts);
+    writeMetric(out, "ircserv_received_bytes_total", "counter", "Bytes read from client sockets.", bytesIn);
+    writeMetric(out, "ircserv_sent_bytes_total", "counter", "Bytes written to client sockets.", bytesOut);
+    writeMetric(out, "ircserv_sent_messages_total", "counter", "Messages queued to clients.", messagesOut);
+    writeMetric(out, "ircserv_sendq_bytes", "gauge", "Output queued and not yet accepted by sockets.", sendqBytes);
+    writeMetric(out, "ircserv_flood_throttle_events_total", "counter", "Times a client ran out of flood-control credit.",
+                throttleEvents);
+    writeMetric(out, "ircserv_flood_throttled_clients", "gauge", "Clients whose input is held back by flood control.",
+                throttledClients);
+    writeMetric(out, "ircserv_log_dropped_total", "counter", "Log lines lost to a full log ring.", logDropped);
+    writeMetric(out, "ircserv_state_lock_waits_total", "counter",
+                "Times an event loop found the shared state lock held by another.", lockWaits);
+    out << "# HELP ircserv_state_lock_wait_seconds_total Time event loops spent waiting for the shared state lock.\n"
+        << "# TYPE ircserv_state_lock_wait_seconds_total counter\n"
+        << "ircserv_state_lock_wait_seconds_total " << static_cast<double>(lockWaitNs) / 1e9 << '\n';
+
+    out << "# HELP ircserv_disconnects_total Connections closed, by reason.\n"
+        << "# TYPE ircserv_disconnects_total counter\n";
+    for (size_t i = 0; i < DISCONNECT_COUNT; ++i) {
+        out << "ircserv_disconnects_total{reason=\"" << DISCONNECT_NAMES[i] << "\"} " << disconnects[i] << '\n';
+    }
+
+    out << "# HELP ircserv_received_messages_total Messages received, by command.\n"
+        << "# TYPE ircserv_received_messages_total counter\n";
+    for (size_t i = 0; i < commands.size() && i < commandNames.size(); ++i) {
+        out << "ircserv_received_messages_total{command=\"" << commandNames[i] << "\"} " << commands[i] << '\n';
+    }
+
+    // Bucket bounds on powers of four from about 1 us to 1 s, so they fall on
+    // histogram bucket edges
+    out << "# HELP ircserv_command_duration_seconds Time spent in command handlers.\n"
+        << "# TYPE ircserv_command_duration_seconds histogram\n";
+    for (size_t i = 0; i < latency.size() && i < commandNames.size(); ++i) {
+        const Histogram& h = latency[i];
+        const std::string& name = commandNames[i];
+        for (unsigned long bound = 1UL << 10; bound <= 1UL << 30; bound <<= 2) {
+            out << "ircserv_command_duration_seconds_bucket{command=\"" << name << "\",le=\""
+                << static_cast<double>(bound) / 1e9 << "\"} " << h.countBelow(bound) << '\n';
+        }
+        out << "ircserv_command_duration_seconds_bucket{command=\"" << name << "\",le=\"+Inf\"} " << h.count() << '\n'
+            << "ircserv_command_duration_seconds_sum{command=\"" << name << "\"} "
+            << static_cast<double>(h.sum()) / 1e9 << '\n'
+            << "ircserv_command_duration_seconds_count{command=\"" << name << "\"} " << h.count() << '\n';
+    }
+    text = out.str();
+}
@@ -0,0 +1,119 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Why a connection ended, counted per reason
+enum DisconnectReason {
+    DISCONNECT_QUIT,
+    DISCONNECT_EOF,                 // Peer closed without QUIT
+    DISCONNECT_READ_ERROR,
+    DISCONNECT_WRITE_ERROR,
+    DISCONNECT_SENDQ,
+    DISCONNECT_PING_TIMEOUT,
+    DISCONNECT_REGISTRATION_TIMEOUT,
+    DISCONNECT_OTHER,
+    DISCONNECT_COUNT
+};
+
+const char* disconnectReasonName(DisconnectReason reason);
+
+// Counter owned by one thread: the owner adds with a plain load and store
+// (no locked instruction), readers on other threads load it relaxed
+inline void bumpCounter(unsigned long& counter, unsigned long n = 1) {
+    __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+inline unsigned long readCounter(const unsigned long& counter) {
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+// Log-linear latency histogram in the HDR style: every power of two is
+// split into SUB_BUCKETS equal buckets, so any recorded value is known to
+// within 12.5% from 1 ns up to about 73 minutes (larger values land in the
+// last bucket). Recording is a few shifts and one counter bump; single
+// writer, like bumpCounter.
+class Histogram {
+public:
+    static const int SUB_BITS = 3;
+    static const size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = 40 * SUB_BUCKETS;
+
+    Histogram();
+
+    void record(unsigned long value);
+    // Adds a relaxed snapshot of this histogram into total
+    void addTo(Histogram& total) const;
+
+    unsigned long count() const { return readCounter(_count); }
+    unsigned long sum() const { return readCounter(_sum); }
+    unsigned long max() const { return readCounter(_max); }
+    // Upper edge of the bucket holding the q-th quantile, at most max(); 0
+    // when empty
+    unsigned long quantile(double q) const;
+    // Recorded values below limit, which must be a power of two so that it
+    // falls on a bucket edge
+    unsigned long countBelow(unsigned long limit) const;
+
+    static size_t bucketOf(unsigned long value);
+    static unsigned long bucketUpper(size_t bucket);    // Exclusive
+
+private:
+    unsigned long _buckets[BUCKETS];
+    unsigned long _count;
+    unsigned long _sum;
+    unsigned long _max;
+};
+
+// Counters of one event loop. Only the owning reactor's thread writes
+// them, so they stay on that thread's cache lines; readers add up every
+// reactor's copy.
+struct ReactorMetrics {
+    unsigned long accepts;
+    unsigned long bytesIn;
+    unsigned long bytesOut;
+    unsigned long messagesOut;      // Messages queued to clients
+    unsigned long sendqBytes;       // Bytes queued and not yet written (gauge)
+    unsigned long lockWaits;        // State lock acquisitions that found it held
+    unsigned long lockWaitNs;       // Time spent waiting for it
+    unsigned long disconnects[DISCONNECT_COUNT];
+    std::vector<unsigned long> commands;    // Per command table index; the last counts unknown commands
+    std::vector<Histogram> latency;         // Handler time in ns, per command table index
+
+    explicit ReactorMetrics(size_t commandSlots);
+
+    // Adds a gauge delta; the gauge never goes below zero
+    void adjustSendq(size_t before, size_t after);
+};
+
+// Totals across every reactor plus server-wide gauges, for STATS and the
+// Prometheus endpoint
+struct MetricsSnapshot {
+    unsigned long accepts;
+    unsigned long bytesIn;
+    unsigned long bytesOut;
+    unsigned long messagesOut;
+    unsigned long sendqBytes;
+    unsigned long lockWaits;
+    unsigned long lockWaitNs;
+    unsigned long disconnects[DISCONNECT_COUNT];
+    std::vector<unsigned long> commands;
+    std::vector<Histogram> latency;
+    std::vector<std::string> commandNames;  // Matches commands; the last is "unknown"
+    unsigned long clients;
+    unsigned long channels;
+    unsigned long throttleEvents;
+    unsigned long throttledClients;
+    unsigned long logDropped;
+    unsigned long uptimeSeconds;
+
+    MetricsSnapshot();
+
+    void add(const ReactorMetrics& reactor);
+    // Prometheus text exposition format, version 0.0.4
+    void writePrometheus(std::string& out) const;
+};
+
+#endif // METRICS_HPP
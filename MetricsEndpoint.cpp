@@ -0,0 +1,132 @@
+#include "MetricsEndpoint.hpp"
+#include "Server.hpp"
+
+static long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+MetricsEndpoint::MetricsEndpoint(int listenFd, Poller& poller, TimerWheel& timers)
+    : _listenFd(listenFd), _poller(poller), _timers(timers) {
+    _poller.add(_listenFd, Poller::EV_READ);
+}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    for (std::map<int, Connection*>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    close(_listenFd);
+}
+
+void MetricsEndpoint::Connection::expire(Server& server) {
+    (void)server;
+    endpoint->closeConnection(fd);
+}
+
+bool MetricsEndpoint::handleEvent(const PollEvent& ev, Server& server) {
+    if (ev.fd == _listenFd) {
+        acceptConnections();
+        return true;
+    }
+    if (_connections.empty()) return false;
+    std::map<int, Connection*>::iterator it = _connections.find(ev.fd);
+    if (it == _connections.end()) return false;
+    Connection& conn = *it->second;
+    if (conn.writing) {
+        if (ev.writable || ev.error) writeResponse(conn);
+    } else if (ev.readable || ev.error) {
+        readRequest(conn, server);
+    }
+    return true;
+}
+
+void MetricsEndpoint::acceptConnections() {
+    while (true) {
+        int fd = accept(_listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        if (_connections.size() >= MAX_CONNECTIONS || fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        try {
+            _poller.add(fd, Poller::EV_READ);
+        } catch (const std::exception& e) {
+            LOG_ERROR(e.what() << ": metrics fd " << fd);
+            close(fd);
+            continue;
+        }
+        Connection* conn = new Connection(this, fd);
+        _connections[fd] = conn;
+        _timers.schedule(*conn, monotonicMs(), IDLE_TIMEOUT_MS);
+    }
+}
+
+// Reads until the end of the request head, then answers it. The body of
+// the reply is rendered under the state lock by Server::renderMetrics.
+void MetricsEndpoint::readRequest(Connection& conn, Server& server) {
+    char buf[2048];
+    while (true) {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            closeConnection(conn.fd);
+            return;
+        }
+        conn.request.append(buf, static_cast<size_t>(n));
+        if (conn.request.size() > MAX_REQUEST) {
+            closeConnection(conn.fd);
+            return;
+        }
+    }
+    if (conn.request.find("\r\n\r\n") == std::string::npos && conn.request.find("\n\n") == std::string::npos) {
+        return;
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (conn.request.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else if (conn.request.compare(4, 9, "/metrics ") != 0 && conn.request.compare(4, 2, "/ ") != 0) {
+        status = "404 Not Found";
+    } else {
+        server.renderMetrics(body);
+    }
+    std::ostringstream head;
+    head << "HTTP/1.0 " << status << "\r\n"
+         << "Content-Type: text/plain; version=0.0.4\r\n"
+         << "Content-Length: " << body.size() << "\r\n"
+         << "Connection: close\r\n\r\n";
+    conn.response = head.str() + body;
+    conn.writing = true;
+    writeResponse(conn);
+}
+
+void MetricsEndpoint::writeResponse(Connection& conn) {
+    while (conn.sent < conn.response.size()) {
+        ssize_t n = send(conn.fd, conn.response.data() + conn.sent, conn.response.size() - conn.sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            _poller.modify(conn.fd, Poller::EV_WRITE);
+            return;
+        }
+        if (n < 0) break;
+        conn.sent += static_cast<size_t>(n);
+    }
+    closeConnection(conn.fd);
+}
+
+void MetricsEndpoint::closeConnection(int fd) {
+    std::map<int, Connection*>::iterator it = _connections.find(fd);
+    if (it == _connections.end()) return;
+    _poller.remove(fd);
+    close(fd);
+    delete it->second;
+    _connections.erase(it);
+}
@@ -0,0 +1,58 @@
+#ifndef METRICSENDPOINT_HPP
+#define METRICSENDPOINT_HPP
+
+#include <string>
+#include <map>
+#include "Poller.hpp"
+#include "TimerWheel.hpp"
+
+class Server;
+
+// Plain HTTP responder for Prometheus scrapes on a separate loopback port.
+// It lives in the first reactor's loop: that loop hands over every event
+// on the listener or on a scrape connection. Each connection sends one
+// request, gets the exposition text back and is closed; a connection that
+// stays silent or unread for IDLE_TIMEOUT_MS is dropped by its timer.
+class MetricsEndpoint {
+public:
+    static const size_t MAX_CONNECTIONS = 16;
+    static const size_t MAX_REQUEST = 8192;
+    static const long IDLE_TIMEOUT_MS = 5000;
+
+    // Takes ownership of listenFd, which must already be listening
+    MetricsEndpoint(int listenFd, Poller& poller, TimerWheel& timers);
+    ~MetricsEndpoint();
+
+    int listenFd() const { return _listenFd; }
+    // Handles ev if its fd belongs to the endpoint; false otherwise.
+    // Called unlocked, from the owning loop.
+    bool handleEvent(const PollEvent& ev, Server& server);
+
+private:
+    struct Connection : public Timer {
+        MetricsEndpoint* endpoint;
+        int fd;
+        std::string request;
+        std::string response;
+        size_t sent;
+        bool writing;
+
+        Connection(MetricsEndpoint* owner, int socket) : endpoint(owner), fd(socket), sent(0), writing(false) {}
+        virtual void expire(Server& server);
+    };
+
+    int _listenFd;
+    Poller& _poller;
+    TimerWheel& _timers;
+    std::map<int, Connection*> _connections;
+
+    void acceptConnections();
+    void readRequest(Connection& conn, Server& server);
+    void writeResponse(Connection& conn);
+    void closeConnection(int fd);
+
+    MetricsEndpoint(const MetricsEndpoint&);
+    MetricsEndpoint& operator=(const MetricsEndpoint&);
+};
+
+#endif // METRICSENDPOINT_HPP
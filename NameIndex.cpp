@@ -0,0 +1,95 @@
+#include "NameIndex.hpp"
+#include "parcer.hpp"
+
+static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+NameIndex::NameIndex() : _slots(16), _used(0), _deleted(0) {}
+
+// FNV-1a over the casefolded bytes
+unsigned int NameIndex::hashName(const char* name, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(ircToLower(name[i]));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool foldedEquals(const std::string& folded, const char* name, size_t len) {
+    if (folded.length() != len) return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (folded[i] != ircToLower(name[i])) return false;
+    }
+    return true;
+}
+
+size_t NameIndex::findSlot(const char* name, size_t len, unsigned int hash) const {
+    size_t mask = _slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot& slot = _slots[i];
+        if (slot.state == EMPTY) return NOT_FOUND;
+        if (slot.state == USED && slot.hash == hash && foldedEquals(slot.key, name, len)) {
+            return i;
+        }
+    }
+}
+
+int NameIndex::find(const char* name, size_t len) const {
+    size_t i = findSlot(name, len, hashName(name, len));
+    return i == NOT_FOUND ? -1 : _slots[i].value;
+}
+
+bool NameIndex::insert(const std::string& name, int value) {
+    unsigned int hash = hashName(name.data(), name.length());
+    if (findSlot(name.data(), name.length(), hash) != NOT_FOUND) return false;
+
+    // Keep the load (tombstones included) under 3/4 so probes stay short
+    if ((_used + _deleted + 1) * 4 > _slots.size() * 3) {
+        rehash(_used * 2 >= _slots.size() ? _slots.size() * 2 : _slots.size());
+    }
+
+    size_t mask = _slots.size() - 1;
+    size_t i = hash & mask;
+    while (_slots[i].state == USED) {
+        i = (i + 1) & mask;
+    }
+    Slot& slot = _slots[i];
+    if (slot.state == DELETED) --_deleted;
+    slot.key.resize(name.length());
+    for (size_t k = 0; k < name.length(); ++k) {
+        slot.key[k] = ircToLower(name[k]);
+    }
+    slot.hash = hash;
+    slot.value = value;
+    slot.state = USED;
+    ++_used;
+    return true;
+}
+
+bool NameIndex::erase(const std::string& name) {
+    size_t i = findSlot(name.data(), name.length(), hashName(name.data(), name.length()));
+    if (i == NOT_FOUND) return false;
+    _slots[i].state = DELETED;
+    _slots[i].key.clear();
+    --_used;
+    ++_deleted;
+    return true;
+}
+
+void NameIndex::rehash(size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(_slots);
+    _deleted = 0;
+    size_t mask = _slots.size() - 1;
+    for (size_t k = 0; k < old.size(); ++k) {
+        if (old[k].state != USED) continue;
+        size_t i = old[k].hash & mask;
+        while (_slots[i].state == USED) {
+            i = (i + 1) & mask;
+        }
+        _slots[i].key.swap(old[k].key);
+        _slots[i].hash = old[k].hash;
+        _slots[i].value = old[k].value;
+        _slots[i].state = USED;
+    }
+}
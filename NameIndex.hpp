@@ -0,0 +1,43 @@
+#ifndef NAMEINDEX_HPP
+#define NAMEINDEX_HPP
+
+#include <string>
+#include <vector>
+
+// Case-insensitive hash index from an IRC name to an int (a client fd for
+// nicknames). Names compare under RFC 1459 casemapping, so "Nick[a]" and
+// "nick{A}" are the same key. Open addressing with linear probing; lookups
+// fold characters on the fly and never allocate.
+class NameIndex {
+public:
+    NameIndex();
+
+    int find(const char* name, size_t len) const;      // -1 when absent
+    int find(const std::string& name) const { return find(name.data(), name.length()); }
+    bool insert(const std::string& name, int value);   // false if already present
+    bool erase(const std::string& name);
+    size_t size() const { return _used; }
+
+    static unsigned int hashName(const char* name, size_t len);
+
+private:
+    enum SlotState { EMPTY, USED, DELETED };
+
+    struct Slot {
+        std::string key;            // Stored casefolded
+        unsigned int hash;
+        int value;
+        unsigned char state;
+
+        Slot() : hash(0), value(-1), state(EMPTY) {}
+    };
+
+    std::vector<Slot> _slots;       // Capacity is a power of two
+    size_t _used;
+    size_t _deleted;
+
+    size_t findSlot(const char* name, size_t len, unsigned int hash) const;
+    void rehash(size_t capacity);
+};
+
+#endif // NAMEINDEX_HPP
@@ -0,0 +1,113 @@
+#include "Numerics.hpp"
+#include <stdexcept>
+
+struct NumericTemplate {
+    NumericId id;
+    int code;
+    const char* text;               // Follows the nickname; each '%' takes the next argument
+};
+
+// Must list every NumericId in enum order, the constructor checks it
+static const NumericTemplate TEMPLATES[NUMERIC_COUNT] = {
+    { RPL_WELCOME,           1, ":Welcome to the IRC Network %" },
+    { RPL_YOURHOST,          2, ":Your host is %, running version 1.0" },
+    { RPL_CREATED,           3, ":This server was created today" },
+    { RPL_MYINFO,            4, "% 1.0 o o" },
+    { RPL_STATSCOMMANDS,   212, "% % :p50 %ns p99 %ns max %ns" },
+    { RPL_ENDOFSTATS,      219, "% :End of STATS report" },
+    { RPL_STATSUPTIME,     242, ":Server Up %" },
+    { RPL_STATSDEBUG,      249, "% :%" },
+    { RPL_USERHOST,        302, ":%" },
+    { RPL_WHOISUSER,       311, "% % % * :%" },
+    { RPL_WHOISSERVER,     312, "% % :IRC Server" },
+    { RPL_ENDOFWHO,        315, "% :End of WHO list" },
+    { RPL_ENDOFWHOIS,      318, "% :End of WHOIS list" },
+    { RPL_WHOISCHANNELS,   319, "% :%" },
+    { RPL_LISTSTART,       321, "Channel :Users  Name" },
+    { RPL_LIST,            322, "% % :%" },
+    { RPL_LISTEND,         323, ":End of LIST" },
+    { RPL_CHANNELMODEIS,   324, "% %" },
+    { RPL_NOTOPIC,         331, "% :No topic is set" },
+    { RPL_TOPIC,           332, "% :%" },
+    { RPL_INVITING,        341, "% %" },
+    { RPL_WHOREPLY,        352, "% % % ircserver % H :0 %" },
+    { RPL_NAMREPLY,        353, "= % :%" },
+    { RPL_ENDOFNAMES,      366, "% :End of NAMES list" },
+    { RPL_MOTD,            372, ":- Welcome to our IRC server!" },
+    { RPL_MOTDSTART,       375, ":- % Message of the day -" },
+    { RPL_ENDOFMOTD,       376, ":End of MOTD command" },
+    { RPL_YOUREOPER,       381, ":You are now an IRC operator" },
+    { ERR_NOSUCHNICK,      401, "% :No such nick/channel" },
+    { ERR_NOSUCHCHANNEL,   403, "% :No such channel" },
+    { ERR_NOORIGIN,        409, ":No origin specified" },
+    { ERR_INPUTTOOLONG,    417, ":Input line was too long" },
+    { ERR_UNKNOWNCOMMAND,  421, "% :Unknown command" },
+    { ERR_NONICKNAMEGIVEN, 431, ":No nickname given" },
+    { ERR_ERRONEUSNICKNAME, 432, "% :Erroneous nickname" },
+    { ERR_NICKNAMEINUSE,   433, "% :Nickname is already in use" },
+    { ERR_USERNOTINCHANNEL, 441, "% % :They aren't on that channel" },
+    { ERR_NOTONCHANNEL,    442, "% :You're not on that channel" },
+    { ERR_USERONCHANNEL,   443, "% % :is already on channel" },
+    { ERR_NOTREGISTERED,   451, ":You have not registered" },
+    { ERR_NEEDMOREPARAMS,  461, "% :Not enough parameters" },
+    { ERR_ALREADYREGISTERED, 462, ":You may not reregister" },
+    { ERR_PASSWDMISMATCH,  464, ":Password incorrect" },
+    { ERR_PASSWDREQUIRED,  464, ":Password required" },
+    { ERR_CHANNELISFULL,   471, "% :Cannot join channel (+l)" },
+    { ERR_INVITEONLYCHAN,  473, "% :Cannot join channel (+i)" },
+    { ERR_BADCHANNELKEY,   475, "% :Cannot join channel (+k)" },
+    { ERR_NOPRIVILEGES,    481, ":Permission Denied- You're not an IRC operator" },
+    { ERR_CHANOPRIVSNEEDED, 482, "% :You're not channel operator" },
+    { ERR_NOOPERHOST,      491, ":No O-lines for your host" }
+};
+
+NumericArg::NumericArg(size_t n) : _data(NULL), _length(0) {
+    do {
+        _digits[sizeof(_digits) - ++_length] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+}
+
+NumericFormatter::NumericFormatter(const std::string& server) {
+    for (size_t i = 0; i < NUMERIC_COUNT; ++i) {
+        const NumericTemplate& entry = TEMPLATES[i];
+        if (entry.id != static_cast<NumericId>(i)) {
+            throw std::logic_error("Numeric templates out of enum order");
+        }
+        char code[5];
+        code[0] = static_cast<char>('0' + entry.code / 100 % 10);
+        code[1] = static_cast<char>('0' + entry.code / 10 % 10);
+        code[2] = static_cast<char>('0' + entry.code % 10);
+        code[3] = ' ';
+        code[4] = '\0';
+        _heads[i] = ":" + server + " " + code;
+    }
+}
+
+void NumericFormatter::format(ReplyBuilder& out, NumericId id, const std::string& nick,
+                              const NumericArg* const* args, size_t argCount) const {
+    out.append(_heads[id]);
+    if (nick.empty()) {
+        out.append('*');
+    } else {
+        out.append(nick);
+    }
+    out.append(' ');
+
+    // Copy the literal runs between placeholders in one piece each
+    const char* text = TEMPLATES[id].text;
+    size_t next = 0;
+    for (;;) {
+        const char* mark = std::strchr(text, '%');
+        if (mark == NULL) {
+            out.append(text);
+            return;
+        }
+        out.append(text, static_cast<size_t>(mark - text));
+        if (next < argCount) {
+            out.append(args[next]->data(), args[next]->length());
+        }
+        ++next;
+        text = mark + 1;
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef NUMERICS_HPP
+#define NUMERICS_HPP
+
+#include <string>
+#include <cstring>
+#include "ReplyBuilder.hpp"
+
+// Every numeric reply the server sends. Some codes appear twice because
+// the same numeric is used with different trailing text.
+enum NumericId {
+    RPL_WELCOME,
+    RPL_YOURHOST,
+    RPL_CREATED,
+    RPL_MYINFO,
+    RPL_STATSCOMMANDS,
+    RPL_ENDOFSTATS,
+    RPL_STATSUPTIME,
+    RPL_STATSDEBUG,
+    RPL_USERHOST,
+    RPL_WHOISUSER,
+    RPL_WHOISSERVER,
+    RPL_ENDOFWHO,
+    RPL_ENDOFWHOIS,
+    RPL_WHOISCHANNELS,
+    RPL_LISTSTART,
+    RPL_LIST,
+    RPL_LISTEND,
+    RPL_CHANNELMODEIS,
+    RPL_NOTOPIC,
+    RPL_TOPIC,
+    RPL_INVITING,
+    RPL_WHOREPLY,
+    RPL_NAMREPLY,
+    RPL_ENDOFNAMES,
+    RPL_MOTD,
+    RPL_MOTDSTART,
+    RPL_ENDOFMOTD,
+    RPL_YOUREOPER,
+    ERR_NOSUCHNICK,
+    ERR_NOSUCHCHANNEL,
+    ERR_NOORIGIN,
+    ERR_INPUTTOOLONG,
+    ERR_UNKNOWNCOMMAND,
+    ERR_NONICKNAMEGIVEN,
+    ERR_ERRONEUSNICKNAME,
+    ERR_NICKNAMEINUSE,
+    ERR_USERNOTINCHANNEL,
+    ERR_NOTONCHANNEL,
+    ERR_USERONCHANNEL,
+    ERR_NOTREGISTERED,
+    ERR_NEEDMOREPARAMS,
+    ERR_ALREADYREGISTERED,
+    ERR_PASSWDMISMATCH,
+    ERR_PASSWDREQUIRED,
+    ERR_CHANNELISFULL,
+    ERR_INVITEONLYCHAN,
+    ERR_BADCHANNELKEY,
+    ERR_NOPRIVILEGES,
+    ERR_CHANOPRIVSNEEDED,
+    ERR_NOOPERHOST,
+    NUMERIC_COUNT
+};
+
+// One '%' argument of a numeric template. Converts implicitly from strings,
+// literals and counts, so call sites read like the reply they send. Only
+// meant to be bound to a const reference for the duration of one call.
+class NumericArg {
+public:
+    NumericArg() : _data(""), _length(0) {}
+    NumericArg(const std::string& s) : _data(s.data()), _length(s.length()) {}
+    NumericArg(const char* s) : _data(s), _length(std::strlen(s)) {}
+    NumericArg(size_t n);
+
+    const char* data() const { return _data != NULL ? _data : _digits + sizeof(_digits) - _length; }
+    size_t length() const { return _length; }
+
+private:
+    const char* _data;              // NULL when the text lives in _digits
+    size_t _length;
+    char _digits[24];
+};
+
+// Expands numeric templates. The ":<server> <ddd> " head of every numeric
+// is built once at startup, so a reply costs one copy of the head, the
+// target nickname and the template text with its arguments.
+class NumericFormatter {
+public:
+    static const size_t MAX_ARGS = 5;
+
+    explicit NumericFormatter(const std::string& server);
+
+    // Appends the reply without CRLF; an empty nick is sent as '*'
+    void format(ReplyBuilder& out, NumericId id, const std::string& nick,
+                const NumericArg* const* args, size_t argCount) const;
+
+private:
+    std::string _heads[NUMERIC_COUNT];
+};
+
+#endif // NUMERICS_HPP
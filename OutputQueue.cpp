@@ -0,0 +1,156 @@
+#include "OutputQueue.hpp"
+#include <cstring>
+#include <new>
+#include <sys/uio.h>
+
+// Upper bound on iovecs per writev, well below any platform's IOV_MAX
+static const size_t MAX_IOV = 64;
+
+// Pooled blocks hold a header plus POOLED_SIZE bytes. Each thread keeps its
+// own free list, so no locking is needed; a block released on another thread
+// than the one that created it simply joins that thread's list.
+static const size_t POOL_BLOCK = sizeof(SharedMessage) + SharedMessage::POOLED_SIZE;
+static const size_t POOL_MAX_FREE = 1024;  // Blocks kept per thread
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+static __thread FreeBlock* t_freeBlocks = NULL;
+static __thread size_t t_freeCount = 0;
+
+SharedMessage* SharedMessage::create(const char* data, size_t len) {
+    SharedMessage* msg;
+    bool pooled = len <= POOLED_SIZE;
+    if (pooled && t_freeBlocks != NULL) {
+        msg = reinterpret_cast<SharedMessage*>(t_freeBlocks);
+        t_freeBlocks = t_freeBlocks->next;
+        --t_freeCount;
+    } else {
+        // sizeof already counts one byte of _bytes, which holds the terminator
+        void* mem = ::operator new(pooled ? POOL_BLOCK : sizeof(SharedMessage) + len);
+        msg = static_cast<SharedMessage*>(mem);
+    }
+    msg->_len = len;
+    msg->_refs = 1;
+    msg->_pooled = pooled;
+    std::memcpy(msg->_bytes, data, len);
+    msg->_bytes[len] = '\0';
+    return msg;
+}
+
+SharedMessage* SharedMessage::create(const std::string& data) {
+    return create(data.data(), data.length());
+}
+
+void SharedMessage::release() {
+    if (__atomic_sub_fetch(&_refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    if (_pooled && t_freeCount < POOL_MAX_FREE) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(this);
+        block->next = t_freeBlocks;
+        t_freeBlocks = block;
+        ++t_freeCount;
+        return;
+    }
+    ::operator delete(this);
+}
+
+MessageRef& MessageRef::operator=(const MessageRef& other) {
+    if (other._msg) other._msg->retain();
+    if (_msg) _msg->release();
+    _msg = other._msg;
+    return *this;
+}
+
+OutputQueue::OutputQueue() : _head(0), _count(0), _headOffset(0), _bytes(0) {}
+
+OutputQueue::OutputQueue(const OutputQueue& other)
+    : _head(0), _count(0), _headOffset(0), _bytes(0) {
+    *this = other;
+}
+
+OutputQueue& OutputQueue::operator=(const OutputQueue& other) {
+    if (this == &other) return *this;
+    clear();
+    for (size_t i = 0; i < other._count; ++i) {
+        push(other._ring[(other._head + i) & (other._ring.size() - 1)]);
+    }
+    _headOffset = other._headOffset;
+    _bytes = other._bytes;
+    return *this;
+}
+
+OutputQueue::~OutputQueue() {
+    clear();
+}
+
+void OutputQueue::grow() {
+    size_t newCap = _ring.empty() ? 8 : _ring.size() * 2;
+    std::vector<SharedMessage*> bigger(newCap, static_cast<SharedMessage*>(NULL));
+    for (size_t i = 0; i < _count; ++i) {
+        bigger[i] = _ring[(_head + i) & (_ring.size() - 1)];
+    }
+    _ring.swap(bigger);
+    _head = 0;
+}
+
+void OutputQueue::push(SharedMessage* msg) {
+    if (_count == _ring.size()) {
+        grow();
+    }
+    msg->retain();
+    _ring[(_head + _count) & (_ring.size() - 1)] = msg;
+    ++_count;
+    _bytes += msg->size();
+}
+
+void OutputQueue::clear() {
+    while (_count > 0) {
+        _ring[_head]->release();
+        _head = (_head + 1) & (_ring.size() - 1);
+        --_count;
+    }
+    _head = 0;
+    _headOffset = 0;
+    _bytes = 0;
+}
+
+// Drop n written bytes from the front, releasing fully written messages
+void OutputQueue::consume(size_t n) {
+    _bytes -= n;
+    while (n > 0) {
+        SharedMessage* front = _ring[_head];
+        size_t left = front->size() - _headOffset;
+        if (n < left) {
+            _headOffset += n;
+            return;
+        }
+        n -= left;
+        front->release();
+        _head = (_head + 1) & (_ring.size() - 1);
+        --_count;
+        _headOffset = 0;
+    }
+}
+
+ssize_t OutputQueue::writeTo(int fd) {
+    struct iovec iov[MAX_IOV];
+    size_t n = 0;
+    size_t offset = _headOffset;
+    for (size_t i = 0; i < _count && n < MAX_IOV; ++i) {
+        SharedMessage* msg = _ring[(_head + i) & (_ring.size() - 1)];
+        iov[n].iov_base = const_cast<char*>(msg->data() + offset);
+        iov[n].iov_len = msg->size() - offset;
+        offset = 0;
+        ++n;
+    }
+    if (n == 0) return 0;
+
+    ssize_t written = writev(fd, iov, static_cast<int>(n));
+    if (written > 0) {
+        consume(static_cast<size_t>(written));
+    }
+    return written;
+}
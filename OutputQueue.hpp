@@ -0,0 +1,85 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <sys/types.h>
+
+// Immutable, reference-counted wire message. A channel broadcast creates one
+// of these and queues the same buffer to every member, so the memory cost of
+// a message is O(1) regardless of how many clients receive it. The count is
+// atomic because a broadcast may be queued on several event-loop threads.
+// Messages up to POOLED_SIZE bytes recycle their storage through a small
+// per-thread free list, so steady traffic does not touch the heap.
+class SharedMessage {
+public:
+    static SharedMessage* create(const char* data, size_t len);
+    static SharedMessage* create(const std::string& data);
+
+    void retain() { __atomic_add_fetch(&_refs, 1, __ATOMIC_RELAXED); }
+    void release();
+
+    const char* data() const { return _bytes; }
+    size_t size() const { return _len; }
+
+    // Covers any line a client can send plus the prefix we add when relaying
+    static const size_t POOLED_SIZE = 1024;
+
+private:
+    size_t _len;
+    int _refs;
+    bool _pooled;                   // Storage came from the block pool
+    char _bytes[1];                 // Allocated inline, _len bytes long
+
+    SharedMessage();
+    SharedMessage(const SharedMessage&);
+    SharedMessage& operator=(const SharedMessage&);
+};
+
+// Owning handle that releases its reference when it goes out of scope
+class MessageRef {
+public:
+    MessageRef() : _msg(NULL) {}
+    explicit MessageRef(SharedMessage* msg) : _msg(msg) {}     // Adopts one reference
+    MessageRef(const MessageRef& other) : _msg(other._msg) { if (_msg) _msg->retain(); }
+    ~MessageRef() { if (_msg) _msg->release(); }
+
+    MessageRef& operator=(const MessageRef& other);
+    SharedMessage* get() const { return _msg; }
+
+private:
+    SharedMessage* _msg;
+};
+
+// Per-client FIFO of message references. Flushing gathers several queued
+// buffers into one writev() call instead of one send() per reply.
+class OutputQueue {
+public:
+    OutputQueue();
+    OutputQueue(const OutputQueue& other);
+    OutputQueue& operator=(const OutputQueue& other);
+    ~OutputQueue();
+
+    void push(SharedMessage* msg);  // Takes its own reference
+    void clear();
+
+    size_t bytes() const { return _bytes; }
+    bool empty() const { return _count == 0; }
+
+    // One writev() of as many queued buffers as fit; returns the result of
+    // writev (bytes written, or -1 with errno set)
+    ssize_t writeTo(int fd);
+
+private:
+    std::vector<SharedMessage*> _ring;  // Capacity is a power of two
+    size_t _head;
+    size_t _count;
+    size_t _headOffset;             // Bytes of the front message already written
+    size_t _bytes;                  // Unwritten bytes across the whole queue
+
+    void grow();
+    void consume(size_t n);
+};
+
+#endif // OUTPUTQUEUE_HPP
@@ -0,0 +1,152 @@
+#include "Poller.hpp"
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+Poller* Poller::create() {
+#ifdef IRC_HAVE_EPOLL
+    try {
+        return new EpollPoller();
+    } catch (const std::exception&) {
+        // Fall through to poll() if the kernel refuses an epoll instance
+    }
+#endif
+    return new PollPoller();
+}
+
+// ---------------------------------------------------------------------------
+// poll() backend
+
+// Every operation is O(1): _position maps an fd to its pollfd, and removal
+// moves the last pollfd into the hole instead of shifting the array
+int& PollPoller::positionOf(int fd) {
+    if (static_cast<size_t>(fd) >= _position.size()) {
+        _position.resize(fd + 1, -1);
+    }
+    return _position[fd];
+}
+
+void PollPoller::add(int fd, int events) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = 0;
+    if (events & EV_READ) pfd.events |= POLLIN;
+    if (events & EV_WRITE) pfd.events |= POLLOUT;
+    pfd.revents = 0;  // Initialize revents to avoid uninitialized memory
+    positionOf(fd) = static_cast<int>(_fds.size());
+    _fds.push_back(pfd);
+}
+
+void PollPoller::modify(int fd, int events) {
+    int pos = positionOf(fd);
+    if (pos < 0) return;
+    _fds[pos].events = 0;
+    if (events & EV_READ) _fds[pos].events |= POLLIN;
+    if (events & EV_WRITE) _fds[pos].events |= POLLOUT;
+}
+
+void PollPoller::remove(int fd) {
+    int& pos = positionOf(fd);
+    if (pos < 0) return;
+    const struct pollfd& last = _fds.back();
+    _fds[pos] = last;
+    _position[last.fd] = pos;
+    _fds.pop_back();
+    pos = -1;
+}
+
+int PollPoller::wait(std::vector<PollEvent>& out, int timeout_ms) {
+    out.clear();
+    int poll_count = poll(_fds.data(), _fds.size(), timeout_ms);
+    if (poll_count < 0) {
+        if (errno == EINTR) return 0;
+        throw std::runtime_error("Poll failed");
+    }
+
+    for (size_t i = 0; i < _fds.size() && static_cast<int>(out.size()) < poll_count; ++i) {
+        short revents = _fds[i].revents;
+        if (revents == 0) continue;
+        PollEvent ev;
+        ev.fd = _fds[i].fd;
+        ev.readable = (revents & POLLIN) != 0;
+        ev.writable = (revents & POLLOUT) != 0;
+        ev.error = (revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+        out.push_back(ev);
+    }
+    return static_cast<int>(out.size());
+}
+
+// ---------------------------------------------------------------------------
+// epoll backend
+
+#ifdef IRC_HAVE_EPOLL
+
+EpollPoller::EpollPoller() : _epfd(-1), _events(1024) {
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epfd < 0) {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+}
+
+EpollPoller::~EpollPoller() {
+    if (_epfd >= 0) close(_epfd);
+}
+
+static uint32_t toEpollEvents(int events) {
+    uint32_t ev = EPOLLET;
+    if (events & Poller::EV_READ) ev |= EPOLLIN | EPOLLRDHUP;
+    if (events & Poller::EV_WRITE) ev |= EPOLLOUT;
+    return ev;
+}
+
+void EpollPoller::add(int fd, int events) {
+    struct epoll_event ev;
+    ev.events = toEpollEvents(events);
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error("Failed to register fd with epoll");
+    }
+}
+
+void EpollPoller::modify(int fd, int events) {
+    struct epoll_event ev;
+    ev.events = toEpollEvents(events);
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollPoller::remove(int fd) {
+    // Closing the fd drops it from the set as well, this just makes it explicit
+    struct epoll_event ev;
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollPoller::wait(std::vector<PollEvent>& out, int timeout_ms) {
+    out.clear();
+    int n = epoll_wait(_epfd, &_events[0], static_cast<int>(_events.size()), timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        throw std::runtime_error("epoll_wait failed");
+    }
+
+    for (int i = 0; i < n; ++i) {
+        uint32_t revents = _events[i].events;
+        PollEvent ev;
+        ev.fd = _events[i].data.fd;
+        ev.readable = (revents & (EPOLLIN | EPOLLRDHUP)) != 0;
+        ev.writable = (revents & EPOLLOUT) != 0;
+        ev.error = (revents & (EPOLLERR | EPOLLHUP)) != 0;
+        out.push_back(ev);
+    }
+
+    // A full batch means more may be pending, give the next wait more room
+    if (n == static_cast<int>(_events.size())) {
+        _events.resize(_events.size() * 2);
+    }
+    return n;
+}
+
+#endif
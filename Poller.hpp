@@ -0,0 +1,79 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include <vector>
+#include <poll.h>
+
+// One readiness notification returned by Poller::wait
+struct PollEvent {
+    int fd;
+    bool readable;
+    bool writable;
+    bool error;         // Hangup or socket error, caller should read to find out
+};
+
+// Event backend used by the server loop. Backends are edge-triggered where
+// the platform allows it, so callers must drain a socket (read/accept until
+// EAGAIN) every time it is reported ready.
+class Poller {
+public:
+    enum {
+        EV_READ = 1,
+        EV_WRITE = 2
+    };
+
+    virtual ~Poller() {}
+
+    virtual void add(int fd, int events) = 0;
+    virtual void modify(int fd, int events) = 0;
+    virtual void remove(int fd) = 0;
+    // Fills 'out' with ready fds; returns the count, 0 on timeout or EINTR
+    virtual int wait(std::vector<PollEvent>& out, int timeout_ms) = 0;
+    virtual const char* name() const = 0;
+
+    // Picks the best backend for this platform (epoll on Linux, poll elsewhere)
+    static Poller* create();
+};
+
+// Portable fallback: level-triggered poll() over every registered fd
+class PollPoller : public Poller {
+public:
+    void add(int fd, int events);
+    void modify(int fd, int events);
+    void remove(int fd);
+    int wait(std::vector<PollEvent>& out, int timeout_ms);
+    const char* name() const { return "poll"; }
+
+private:
+    std::vector<struct pollfd> _fds;
+    std::vector<int> _position;     // fd -> index in _fds, -1 when not registered
+
+    int& positionOf(int fd);
+};
+
+#if defined(__linux__) && !defined(IRC_USE_POLL)
+# define IRC_HAVE_EPOLL 1
+# include <sys/epoll.h>
+
+// Linux default: edge-triggered epoll, cost per wakeup scales with ready fds only
+class EpollPoller : public Poller {
+public:
+    EpollPoller();
+    ~EpollPoller();
+
+    void add(int fd, int events);
+    void modify(int fd, int events);
+    void remove(int fd);
+    int wait(std::vector<PollEvent>& out, int timeout_ms);
+    const char* name() const { return "epoll"; }
+
+private:
+    int _epfd;
+    std::vector<struct epoll_event> _events;
+
+    EpollPoller(const EpollPoller&);
+    EpollPoller& operator=(const EpollPoller&);
+};
+#endif
+
+#endif // POLLER_HPP
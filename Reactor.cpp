@@ -0,0 +1,87 @@
+#include "Reactor.hpp"
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+Mailbox::Mailbox() : _head(&_stub), _tail(&_stub) {}
+
+Mailbox::~Mailbox() {
+    MailItem* item;
+    while ((item = pop()) != NULL) {
+        delete item;
+    }
+}
+
+void Mailbox::push(MailItem* item) {
+    __atomic_store_n(&item->next, static_cast<MailItem*>(NULL), __ATOMIC_RELAXED);
+    MailItem* prev = __atomic_exchange_n(&_head, item, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, item, __ATOMIC_RELEASE);
+}
+
+MailItem* Mailbox::pop() {
+    MailItem* tail = _tail;
+    MailItem* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &_stub) {
+        if (next == NULL) return NULL;
+        _tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&_head, __ATOMIC_ACQUIRE)) {
+        return NULL;                // A producer is between its two steps
+    }
+    // tail is the last real item: park the stub behind it so it can be taken
+    push(&_stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        _tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+Reactor::Reactor(size_t idx, size_t reactorCount, size_t recvBufferSize)
+    : index(idx), poller(NULL), listenFd(-1), wakeRead(-1), wakeWrite(-1),
+      wakePending(0), threadStarted(false), outbox(reactorCount, static_cast<MailItem*>(NULL)),
+      nowMs(0), metrics(commandTableSize() + 1), recvBuffer(recvBufferSize) {
+    params.reserve(MessageView::MAX_PARAMS);
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        throw std::runtime_error("Failed to create reactor wake pipe");
+    }
+    wakeRead = fds[0];
+    wakeWrite = fds[1];
+    fcntl(wakeRead, F_SETFL, O_NONBLOCK);
+    fcntl(wakeWrite, F_SETFL, O_NONBLOCK);
+    fcntl(wakeRead, F_SETFD, FD_CLOEXEC);
+    fcntl(wakeWrite, F_SETFD, FD_CLOEXEC);
+}
+
+Reactor::~Reactor() {
+    delete poller;
+    if (listenFd >= 0) close(listenFd);
+    if (wakeRead >= 0) close(wakeRead);
+    if (wakeWrite >= 0) close(wakeWrite);
+}
+
+void Reactor::wake() {
+    // Only the first producer since the last drain pays for the syscall
+    if (__atomic_exchange_n(&wakePending, 1, __ATOMIC_ACQ_REL) == 0) {
+        char byte = 1;
+        ssize_t ignored = write(wakeWrite, &byte, 1);
+        (void)ignored;
+    }
+}
+
+void Reactor::clearWake() {
+    char buf[64];
+    while (read(wakeRead, buf, sizeof(buf)) > 0) {
+    }
+    __atomic_store_n(&wakePending, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,122 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <pthread.h>
+#include <ctime>
+#include "Poller.hpp"
+#include "OutputQueue.hpp"
+#include "parcer.hpp"
+#include "FdTable.hpp"
+#include "BumpArena.hpp"
+#include "TimerWheel.hpp"
+#include "Metrics.hpp"
+
+struct ClientInfo;
+
+// One shared message on its way to clients owned by another event-loop thread
+struct MailItem {
+    MailItem* next;                 // Mailbox link
+    MessageRef msg;
+    std::vector<std::pair<int, unsigned long> > targets;   // fd and ClientInfo::id
+    // A removal instead of a message: the owner closes the targets itself
+    bool close;
+    DisconnectReason closeKind;
+    std::string closeReason;
+
+    MailItem() : next(NULL), close(false), closeKind(DISCONNECT_OTHER) {}
+};
+
+// Lock-free multi-producer, single-consumer queue (Vyukov's intrusive node
+// design). Any thread may push; only the owning reactor pops.
+class Mailbox {
+public:
+    Mailbox();
+    ~Mailbox();
+
+    void push(MailItem* item);
+    // Oldest item, or NULL when empty. May also return NULL while a push is
+    // half-way done; the producer wakes the owner again once it completes.
+    MailItem* pop();
+
+private:
+    MailItem* _head;                // Newest item, producers swap it
+    MailItem* _tail;                // Oldest item, consumer only
+    MailItem _stub;
+
+    Mailbox(const Mailbox&);
+    Mailbox& operator=(const Mailbox&);
+};
+
+// Per-thread event loop state. Each reactor has its own poller and
+// SO_REUSEPORT listener, and owns the connections it accepted: only its
+// thread reads, writes or closes them. Shared IRC state (clients, channels,
+// nicknames) lives in Server behind the state lock; output for another
+// reactor's clients travels through that reactor's mailbox.
+struct Reactor {
+    size_t index;
+    Poller* poller;
+    int listenFd;
+    int wakeRead;                   // Self-pipe, readable when mail is waiting
+    int wakeWrite;
+    int wakePending;                // Set by producers, cleared by the owner
+    Mailbox mailbox;
+    pthread_t thread;
+    bool threadStarted;
+
+    FdTable<ClientInfo> clients;            // Connections owned by this reactor
+    std::vector<FdRef> pendingClose;        // Marked by markForDisconnect
+    std::vector<FdRef> dirty;               // Clients with output queued this batch
+    FdQueue ready;                          // Clients with input to handle, served round-robin
+    FdQueue tasks;                          // Clients with a Task in progress
+    std::vector<MailItem*> outbox;          // Per-reactor batch while broadcasting
+    TimerWheel timers;                      // Deadlines of this reactor's clients
+    long nowMs;                             // Monotonic ms, read after each poll wait
+    ReactorMetrics metrics;                 // Written by this thread only
+
+    // Per-thread parse state, reused for every line
+    std::vector<char> recvBuffer;
+    MessageView message;
+    std::vector<std::string> params;
+    std::string paramStorage[MessageView::MAX_PARAMS];
+    BumpArena scratch;                      // Reply temporaries, rewound per command
+
+    Reactor(size_t idx, size_t reactorCount, size_t recvBufferSize);
+    ~Reactor();
+
+    void wake();                    // Any thread
+    void clearWake();               // Owner thread, before draining the mailbox
+
+private:
+    Reactor(const Reactor&);
+    Reactor& operator=(const Reactor&);
+};
+
+// Scoped pthread mutex lock
+class MutexGuard {
+public:
+    explicit MutexGuard(pthread_mutex_t& mutex) : _mutex(mutex) { pthread_mutex_lock(&_mutex); }
+    // Also counts, on the calling reactor's metrics, the acquisitions that
+    // had to wait for another thread and the time spent waiting
+    MutexGuard(pthread_mutex_t& mutex, ReactorMetrics& metrics) : _mutex(mutex) {
+        if (pthread_mutex_trylock(&_mutex) == 0) return;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pthread_mutex_lock(&_mutex);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        bumpCounter(metrics.lockWaits);
+        bumpCounter(metrics.lockWaitNs,
+                    static_cast<unsigned long>((end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec));
+    }
+    ~MutexGuard() { pthread_mutex_unlock(&_mutex); }
+
+private:
+    pthread_mutex_t& _mutex;
+
+    MutexGuard(const MutexGuard&);
+    MutexGuard& operator=(const MutexGuard&);
+};
+
+#endif // REACTOR_HPP
@@ -0,0 +1,32 @@
+#include "ReplyBuilder.hpp"
+
+// Enough for most lines, so a typical reply takes a single bump
+static const size_t INITIAL_CAPACITY = 256;
+
+ReplyBuilder& ReplyBuilder::append(const char* s, size_t n) {
+    if (_len + n + 2 > _cap) {
+        // Keep room for the CRLF finish() adds
+        size_t cap = _cap == 0 ? INITIAL_CAPACITY : _cap * 2;
+        while (cap < _len + n + 2) cap *= 2;
+        _data = static_cast<char*>(_arena.grow(_data, _len, cap));
+        _cap = cap;
+    }
+    std::memcpy(_data + _len, s, n);
+    _len += n;
+    return *this;
+}
+
+ReplyBuilder& ReplyBuilder::appendNumber(unsigned long n) {
+    char digits[24];
+    size_t i = sizeof(digits);
+    do {
+        digits[--i] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    return append(digits + i, sizeof(digits) - i);
+}
+
+SharedMessage* ReplyBuilder::finish() {
+    append("\r\n", 2);
+    return SharedMessage::create(_data, _len);
+}
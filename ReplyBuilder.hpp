@@ -0,0 +1,43 @@
+#ifndef REPLYBUILDER_HPP
+#define REPLYBUILDER_HPP
+
+#include <string>
+#include <cstring>
+#include "BumpArena.hpp"
+#include "OutputQueue.hpp"
+
+// Assembles one outgoing IRC line in the event loop's scratch arena and
+// hands it over as a SharedMessage. Replaces operator+ chains, which build
+// and throw away a std::string per '+'.
+//
+//     ReplyBuilder line(server->scratch());
+//     line.append(client.prefix).append(" PART ").append(channel);
+//     server->sendReply(fd, line);
+class ReplyBuilder {
+public:
+    explicit ReplyBuilder(BumpArena& arena) : _arena(arena), _data(NULL), _len(0), _cap(0) {}
+
+    ReplyBuilder& append(const char* s, size_t n);
+    ReplyBuilder& append(const char* s) { return append(s, std::strlen(s)); }
+    ReplyBuilder& append(const std::string& s) { return append(s.data(), s.length()); }
+    ReplyBuilder& append(char c) { return append(&c, 1); }
+    ReplyBuilder& appendNumber(unsigned long n);
+
+    // Appends CRLF and returns the line as a new message holding one reference
+    SharedMessage* finish();
+    void clear() { _len = 0; }
+    // Drops everything after the first len bytes, e.g. to reuse a common head
+    void truncate(size_t len) { if (len < _len) _len = len; }
+    size_t length() const { return _len; }
+
+private:
+    BumpArena& _arena;
+    char* _data;
+    size_t _len;
+    size_t _cap;
+
+    ReplyBuilder(const ReplyBuilder&);
+    ReplyBuilder& operator=(const ReplyBuilder&);
+};
+
+#endif // REPLYBUILDER_HPP
@@ -1,514 +1,1245 @@
 #include "Server.hpp"
 #include "parcer.hpp"
 
-static bool g_server_running = true;
+static volatile sig_atomic_t g_server_running = 1;
+
+// Reactor driving the calling thread, set once when its loop starts
+static __thread Reactor* t_reactor = NULL;
 
 const std::string Server::SERVER_NAME = "A_DreamServ";
 
-std::string ChannelInfo::getModeString() const {
-    std::string modes = "+";
-    if (inviteOnly) modes += "i";
-    if (topicRestricted) modes += "t";
-    if (!key.empty()) modes += "k";
-    if (userLimit > 0) modes += "l";
-    return modes;
+static long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
 }
 
 void Server::signalHandler(int signum) {
     (void)signum;
-    g_server_running = false;
+    g_server_running = 0;
 }
 
-Server::Server(int port, const std::string &password)
-    : _port(port), _password(password), _sockfd(-1) {
-    std::cout << "IRC Server starting on port " << _port << std::endl;
+Server::Server(int port, const std::string &password, const ServerConfig& config)
+    : _port(port), _password(password), _config(config), _nextClientId(0), _channels(_symbols), _numerics(SERVER_NAME),
+      _throttleEvents(0), _throttledClients(0), _startedNs(monotonicNs()), _metricsEndpoint(NULL), _capture(NULL),
+      _offlineDropped(0) {
+    pthread_mutex_init(&_stateLock, NULL);
+    LOG_INFO("IRC Server starting on port " << _port);
     signal(SIGINT, Server::signalHandler);
     signal(SIGQUIT, Server::signalHandler);
+    // A peer closing mid-write must surface as EPIPE, not kill the process
+    signal(SIGPIPE, SIG_IGN);
 }
 
 Server::~Server() {
-    for (size_t i = 0; i < _fds.size(); ++i) {
-        close(_fds[i].fd);
+    delete _metricsEndpoint;
+    delete _capture;
+    for (int fd = 0; fd < _clients.fdLimit(); ++fd) {
+        ClientInfo* client = _clients.find(fd);
+        if (client == NULL) continue;
+        delete client->task;
+        close(fd);
+    }
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        delete _reactors[i];
     }
+    pthread_mutex_destroy(&_stateLock);
 }
 
-void Server::setup() {
-    _sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (_sockfd < 0) {
+int Server::createListener(int port, bool reusePort, bool loopbackOnly) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
         throw std::runtime_error("Failed to create socket");
     }
 
-    if (fcntl(_sockfd, F_SETFL, O_NONBLOCK) < 0) {
+    if (fcntl(sockfd, F_SETFL, O_NONBLOCK) < 0) {
+        close(sockfd);
         throw std::runtime_error("Failed to set socket to non-blocking");
     }
 
     int opt = 1;
-    if (setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        close(sockfd);
         throw std::runtime_error("Failed to set socket options");
     }
+#ifdef SO_REUSEPORT
+    // Every reactor binds its own listener; the kernel spreads new connections
+    if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(sockfd);
+        throw std::runtime_error("Failed to set SO_REUSEPORT");
+    }
+#else
+    (void)reusePort;
+#endif
 
     sockaddr_in serv_addr;
+    std::memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(_port);
+    serv_addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    serv_addr.sin_port = htons(port);
 
-    if (bind(_sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    if (bind(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sockfd);
         throw std::runtime_error("Failed to bind socket");
     }
 
-    if (listen(_sockfd, 10) < 0) {
+    if (listen(sockfd, _config.listenBacklog) < 0) {
+        close(sockfd);
         throw std::runtime_error("Failed to listen on socket");
     }
+    return sockfd;
+}
 
-    struct pollfd pfd;
-    pfd.fd = _sockfd;
-    pfd.events = POLLIN;
-    pfd.revents = 0;  // Initialize revents to avoid uninitialized memory
-    _fds.push_back(pfd);
+void Server::setup() {
+    size_t count = _config.threads;
+#ifndef SO_REUSEPORT
+    if (count > 1) {
+        LOG_WARN("SO_REUSEPORT is not available, running a single event loop");
+        count = 1;
+    }
+#endif
+
+    for (size_t i = 0; i < count; ++i) {
+        Reactor* reactor = new Reactor(i, count, _config.recvBufferSize);
+        _reactors.push_back(reactor);
+        reactor->listenFd = createListener(_port, count > 1, false);
+        reactor->poller = Poller::create();
+        reactor->poller->add(reactor->listenFd, Poller::EV_READ);
+        reactor->poller->add(reactor->wakeRead, Poller::EV_READ);
+    }
+    LOG_INFO("Using " << _reactors[0]->poller->name() << " event backend, "
+             << count << " event loop thread(s)");
+    if (_config.metricsPort != 0) {
+        Reactor& first = *_reactors[0];
+        _metricsEndpoint = new MetricsEndpoint(createListener(_config.metricsPort, false, true),
+                                               *first.poller, first.timers);
+        LOG_INFO("Serving metrics on 127.0.0.1:" << _config.metricsPort);
+    }
+    if (!_config.capturePath.empty()) {
+        _capture = new CaptureWriter(_config.capturePath);
+        LOG_INFO("Recording inbound traffic to " << _config.capturePath);
+    }
+}
+
+void* Server::reactorThread(void* arg) {
+    std::pair<Server*, Reactor*>* ctx = static_cast<std::pair<Server*, Reactor*>*>(arg);
+    ctx->first->runReactor(*ctx->second);
+    delete ctx;
+    return NULL;
 }
 
 void Server::run() {
     setup();
-    // std::cout << "IRC Server running on port " << _port << std::endl;
-    
+
+    // Worker threads leave signals to the main thread
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (size_t i = 1; i < _reactors.size(); ++i) {
+        std::pair<Server*, Reactor*>* ctx = new std::pair<Server*, Reactor*>(this, _reactors[i]);
+        if (pthread_create(&_reactors[i]->thread, NULL, &Server::reactorThread, ctx) != 0) {
+            delete ctx;
+            g_server_running = 0;
+            break;
+        }
+        _reactors[i]->threadStarted = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    runReactor(*_reactors[0]);
+
+    // Reactor 0 runs on the main thread and sees the signal first
+    g_server_running = 0;
+    for (size_t i = 1; i < _reactors.size(); ++i) {
+        if (_reactors[i]->threadStarted) {
+            _reactors[i]->wake();
+            pthread_join(_reactors[i]->thread, NULL);
+        }
+    }
+}
+
+void Server::runReactor(Reactor& reactor) {
+    t_reactor = &reactor;
+
+    // Only sockets that became ready are returned, idle clients cost nothing here
+    std::vector<PollEvent> events;
+    bool runnable = false;
     while (g_server_running) {
-        int poll_count = poll(_fds.data(), _fds.size(), -1);
-        if (poll_count < 0) {
-            if (errno == EINTR) {
-                if (!g_server_running) break;
-                continue; // Interrupted by signal, continue loop
+        // Work left over from the last iteration must not wait for an event,
+        // and the next timer must not wait past its deadline
+        int timeout = reactor.timers.nextTimeout(monotonicNs() / 1000000);
+        reactor.poller->wait(events, runnable || !reactor.ready.empty() ? 0 : timeout);
+        reactor.nowMs = monotonicNs() / 1000000;
+
+        // The event list is a snapshot, so it stays valid if removeClient is called
+        for (size_t i = 0; i < events.size(); ++i) {
+            const PollEvent& ev = events[i];
+            if (ev.fd == reactor.listenFd) {
+                handleNewConnection(reactor);
+                continue;
+            }
+            if (ev.fd == reactor.wakeRead) {
+                reactor.clearWake();
+                continue;
+            }
+            if (_metricsEndpoint != NULL && reactor.index == 0 && _metricsEndpoint->handleEvent(ev, *this)) {
+                continue;
+            }
+            // Input is only noted here and read by runScheduled, in turns
+            if (ev.readable || ev.error) {
+                markReadable(reactor, ev.fd);
+            }
+            if (ev.writable && reactor.clients.find(ev.fd)) {
+                handleClientWrite(reactor, ev.fd);
             }
-            throw std::runtime_error("Poll failed");
         }
 
-        if (_fds[0].revents & POLLIN) {
-            handleNewConnection();
+        // Output, and removals, other threads produced for our clients
+        deliverMail(reactor);
+
+        // Keepalive and flood-control deadlines; expiries may queue output,
+        // mark clients for closing or make throttled clients ready again
+        if (reactor.timers.due(reactor.nowMs)) {
+            MutexGuard lock(_stateLock, reactor.metrics);
+            reactor.timers.advance(reactor.nowMs, *this);
+            reactor.scratch.reset();
         }
 
-        // Collect file descriptors to process to avoid iterator invalidation
-        // Checking which fds have data to read and collect then into fds_to_process
-        std::vector<int> fds_to_process;
-        for (size_t i = 1; i < _fds.size(); ++i) {
-            if (_fds[i].revents & POLLIN) {
-                fds_to_process.push_back(_fds[i].fd);
+        runScheduled(reactor);
+
+        // Drop clients marked while handling this batch, then write what was queued
+        do {
+            if (!reactor.pendingClose.empty()) {
+                MutexGuard lock(_stateLock, reactor.metrics);
+                reapClients(reactor);
             }
-        }
-        
-        // Process collected fds (safe even if removeClient is called)
-        for (size_t i = 0; i < fds_to_process.size(); ++i) {
-            // Check if client still exists (might have been removed)
-            if (_clients.find(fds_to_process[i]) != _clients.end()) {
-                handleClientData(fds_to_process[i]);
+            flushDirty(reactor);
+        } while (!reactor.pendingClose.empty());
+        // Checked after the flush, which may just have made room for a task
+        runnable = hasRunnableWork(reactor);
+    }
+}
+
+// Accept one pending connection as a non-blocking, close-on-exec socket.
+// Returns -1 with errno set like accept().
+static int acceptClient(int listenFd) {
+#if defined(__linux__)
+    return accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) return -1;
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+void Server::handleNewConnection(Reactor& reactor) {
+    // The listener is edge-triggered, so drain every pending connection. A
+    // reconnect storm is admitted in one pass instead of one per wakeup.
+    while (true) {
+        int client_fd = acceptClient(reactor.listenFd);
+        if (client_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // No pending connections, not an error for non-blocking socket
+                return;
             }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            LOG_ERROR("Failed to accept new connection: " << strerror(errno));
+            return;
         }
+
+        try {
+            reactor.poller->add(client_fd, Poller::EV_READ);
+        } catch (const std::exception& e) {
+            LOG_ERROR(e.what() << ": fd " << client_fd);
+            close(client_fd);
+            continue;
+        }
+
+        {
+            MutexGuard lock(_stateLock, reactor.metrics);
+            adoptClient(reactor, client_fd);
+        }
+        LOG_INFO("New client connected: fd " << client_fd);
     }
-    // std::cout << "\nShutting down IRC server." << std::endl;
 }
 
-void Server::handleNewConnection() {
-    sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd = accept(_sockfd, (struct sockaddr *)&client_addr, &client_len);
-    if (client_fd < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // No pending connections, not an error for non-blocking socket
-            return;
+// Called with the state lock held, on reactor's thread
+void Server::adoptClient(Reactor& reactor, int fd) {
+    ClientInfo& client = _clients.acquire(fd);
+    client.id = ++_nextClientId;
+    client.owner = reactor.index;
+    long now = monotonicNs() / 1000000;
+    client.floodTokens = static_cast<long>(_config.floodBurst) * 1000;
+    client.floodStamp = now;
+    client.lastInput = now;
+    reactor.clients.insert(fd, &client);
+    bumpCounter(reactor.metrics.accepts);
+    reactor.timers.schedule(client.keepalive, now, static_cast<long>(_config.registerTimeout) * 1000);
+    if (_capture != NULL) _capture->connect(client.id);
+}
+
+void Server::setupOffline() {
+    Reactor* reactor = new Reactor(0, 1, _config.recvBufferSize);
+    _reactors.push_back(reactor);
+    // poll() tolerates descriptors it cannot wait on, such as /dev/null
+    reactor->poller = new PollPoller();
+    t_reactor = reactor;
+}
+
+void Server::attachClient(int fd) {
+    Reactor& reactor = *t_reactor;
+    reactor.poller->add(fd, Poller::EV_READ);
+    MutexGuard lock(_stateLock);
+    adoptClient(reactor, fd);
+}
+
+void Server::detachClient(int fd) {
+    MutexGuard lock(_stateLock);
+    removeClient(fd, DISCONNECT_EOF);
+}
+
+bool Server::feedInput(int fd, const char* data, size_t n) {
+    Reactor& reactor = *t_reactor;
+    reactor.nowMs = monotonicNs() / 1000000;
+    size_t quota = static_cast<size_t>(-1);
+    bool alive;
+    {
+        MutexGuard lock(_stateLock);
+        ClientInfo* client = reactor.clients.find(fd);
+        if (client != NULL) {
+            client->lastInput = reactor.nowMs;
+            bumpCounter(reactor.metrics.bytesIn, static_cast<unsigned long>(n));
+        }
+        alive = processInput(reactor, fd, data, n, quota);
+        if (!reactor.pendingClose.empty()) {
+            reapClients(reactor);
+        }
+    }
+    settleOffline(reactor);
+    return alive && reactor.clients.find(fd) != NULL;
+}
+
+bool Server::dispatchLine(int fd, const char* line, size_t len) {
+    Reactor& reactor = *t_reactor;
+    bool handled;
+    {
+        MutexGuard lock(_stateLock);
+        if (reactor.clients.find(fd) == NULL) return false;
+        handled = processMessage(fd, line, len);
+        if (!reactor.pendingClose.empty()) {
+            reapClients(reactor);
         }
-        std::cerr << "Failed to accept new connection: " << strerror(errno) << std::endl;
-        return;
     }
+    settleOffline(reactor);
+    return handled;
+}
 
-    if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
-        std::cerr << "Failed to set client socket to non-blocking" << std::endl;
-        close(client_fd);
-        return;
+size_t Server::discardOutput() {
+    dropOutput(*t_reactor);
+    size_t dropped = _offlineDropped;
+    _offlineDropped = 0;
+    return dropped;
+}
+
+// What the event loop would do next, minus the writes: steps every task
+// until it finishes, dropping its replies so it never waits on a full
+// SendQ, and hands the input its client held back meanwhile to dispatch,
+// which may start the next task
+void Server::settleOffline(Reactor& reactor) {
+    while (!reactor.tasks.empty() || !reactor.ready.empty()) {
+        dropOutput(reactor);
+        runTasks(reactor);
+        for (size_t n = reactor.ready.size(); n > 0; --n) {
+            FdRef ref = reactor.ready.pop();
+            ClientInfo* client = reactor.clients.find(ref.fd, ref.generation);
+            if (client == NULL) continue;
+            client->readyQueued = false;
+            if (client->closing || client->task != NULL || !client->inputPending) continue;
+            client->inputPending = false;
+            size_t quota = static_cast<size_t>(-1);
+            MutexGuard lock(_stateLock);
+            processInput(reactor, ref.fd, NULL, 0, quota);
+        }
+        if (!reactor.pendingClose.empty()) {
+            MutexGuard lock(_stateLock);
+            reapClients(reactor);
+        }
     }
+}
+
+void Server::dropOutput(Reactor& reactor) {
+    for (size_t i = 0; i < reactor.dirty.size(); ++i) {
+        ClientInfo* client = reactor.clients.find(reactor.dirty[i].fd, reactor.dirty[i].generation);
+        if (client == NULL) continue;
+        client->flushQueued = false;
+        _offlineDropped += client->pendingOutput();
+        reactor.metrics.adjustSendq(client->pendingOutput(), 0);
+        client->sendq.clear();
+    }
+    reactor.dirty.clear();
+}
+
+// Scheduling: a client's turn handles at most TURN_LINES lines, and one
+// loop iteration keeps giving turns and task steps for at most
+// ITERATION_BUDGET_NS before polling again. Tasks pause while their client
+// has TASK_SENDQ_WATERMARK bytes queued, or half its SendQ if that is less.
+static const size_t TURN_LINES = 64;
+static const long ITERATION_BUDGET_NS = 2000000;
+static const size_t TASK_SENDQ_WATERMARK = 64 * 1024;
 
-    struct pollfd pfd;
-    pfd.fd = client_fd;
-    pfd.events = POLLIN;
-    pfd.revents = 0;  // Initialize revents to avoid uninitialized memory
-    _fds.push_back(pfd);
+void Server::markReadable(Reactor& reactor, int fd) {
+    ClientInfo* client = reactor.clients.find(fd);
+    if (client == NULL) return;
+    client->readable = true;
+    enqueueReady(reactor, *client);
+}
 
-    _clients.insert(std::make_pair(client_fd, ClientInfo(client_fd)));
-    std::cout << "New client connected: fd " << client_fd << std::endl;
+void Server::enqueueReady(Reactor& reactor, ClientInfo& client) {
+    // A throttled client is queued again by its throttle timer
+    if (client.readyQueued || client.closing || client.throttledUntil != 0) return;
+    client.readyQueued = true;
+    reactor.ready.push(FdRef(client.fd, reactor.clients.generation(client.fd)));
 }
 
-void Server::handleClientData(int fd) {
-    char buffer[512];
-    int nbytes = recv(fd, buffer, sizeof(buffer) - 1, 0);
+// Round-robin over clients with input and over tasks: each round gives
+// every client that was ready when it began one turn, then every task one
+// step, so one busy client cannot starve the rest
+void Server::runScheduled(Reactor& reactor) {
+    long deadline = monotonicNs() + ITERATION_BUDGET_NS;
+    do {
+        for (size_t n = reactor.ready.size(); n > 0; --n) {
+            FdRef ref = reactor.ready.pop();
+            ClientInfo* client = reactor.clients.find(ref.fd, ref.generation);
+            if (client == NULL) continue;
+            client->readyQueued = false;
+            // A client with a task is requeued when the task finishes
+            if (client->closing || client->task != NULL) continue;
+            if (serviceClient(reactor, *client)) {
+                enqueueReady(reactor, *client);
+            }
+        }
+        if (!reactor.tasks.empty()) {
+            runTasks(reactor);
+            flushDirty(reactor);
+        }
+    } while (hasRunnableWork(reactor) && monotonicNs() < deadline);
+}
+
+// One turn: leftover lines first, then fresh input until the socket is
+// drained or the turn's line quota is used. Returns true when the client
+// has more input to handle; false also when it was removed.
+bool Server::serviceClient(Reactor& reactor, ClientInfo& client) {
+    int fd = client.fd;
+    size_t quota = TURN_LINES;
+    if (client.inputPending) {
+        client.inputPending = false;
+        bool alive;
+        {
+            MutexGuard lock(_stateLock, reactor.metrics);
+            alive = processInput(reactor, fd, NULL, 0, quota);
+        }
+        flushDirty(reactor);
+        if (!alive) return false;
+    }
+
+    while (quota > 0 && client.readable && !client.inputPending && client.task == NULL && client.throttledUntil == 0) {
+        ssize_t nbytes = recv(fd, &reactor.recvBuffer[0], reactor.recvBuffer.size(), 0);
+
+        if (nbytes <= 0) {
+            if (nbytes == 0) {
+                LOG_INFO("Client fd " << fd << " disconnected");
+                MutexGuard lock(_stateLock, reactor.metrics);
+                removeClient(fd, DISCONNECT_EOF);
+                return false;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("Error receiving data from client " << fd << ": " << strerror(errno));
+                MutexGuard lock(_stateLock, reactor.metrics);
+                removeClient(fd, DISCONNECT_READ_ERROR);
+                return false;
+            }
+            // Drained; the next edge marks it readable again
+            client.readable = false;
+            break;
+        }
+        // Any input proves the connection alive, so keepalive needs no
+        // timer update per read
+        client.lastInput = reactor.nowMs;
+        client.pingSent = false;
+        bumpCounter(reactor.metrics.bytesIn, static_cast<unsigned long>(nbytes));
 
-    if (nbytes <= 0) {
-        if (nbytes == 0) {
-            std::cout << "Client fd " << fd << " disconnected" << std::endl;
-            removeClient(fd);
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            std::cerr << "Error receiving data from client " << fd << ": " << strerror(errno) << std::endl;
-            removeClient(fd);
+        // The syscall above runs unlocked, command handling needs the shared state
+        bool alive;
+        {
+            MutexGuard lock(_stateLock, reactor.metrics);
+            alive = processInput(reactor, fd, &reactor.recvBuffer[0], static_cast<size_t>(nbytes), quota);
         }
-        // If EAGAIN/EWOULDBLOCK, just return without removing client
+        // Write out the replies to this chunk before reading the next one, so
+        // queued output stays bounded by what one recv can trigger
+        flushDirty(reactor);
+        if (!alive) {
+            return false;
+        }
+    }
+    if (client.throttledUntil != 0) {
+        // Unread input stays in the kernel, so the sender feels TCP backpressure
+        long now = monotonicNs() / 1000000;
+        reactor.timers.schedule(client.throttle, now, client.throttledUntil - now);
+        updateInterest(reactor, client);
+        return false;
+    }
+    return !client.closing && client.task == NULL && (client.inputPending || client.readable);
+}
+
+void Server::startTask(int fd, Task* task) {
+    ClientInfo& client = *_clients.find(fd);
+    if (!task->step(*this, fd)) {
+        delete task;
         return;
     }
+    client.task = task;
+    t_reactor->tasks.push(FdRef(fd, t_reactor->clients.generation(fd)));
+}
 
-    buffer[nbytes] = '\0';
-    
-    // Check if client still exists (might have been removed)
-    if (_clients.find(fd) == _clients.end()) {
+// Looks fd up in the reactor's own table rather than the shared arena,
+// which another reactor may be growing, so no lock is needed
+bool Server::outputBacklogged(int fd) {
+    ClientInfo* client = t_reactor->clients.find(fd);
+    return client == NULL || outputBacklogged(*client);
+}
+
+bool Server::outputBacklogged(const ClientInfo& client) const {
+    return client.closing || client.pendingOutput() >= std::min(TASK_SENDQ_WATERMARK, _config.sendQueueMax / 2);
+}
+
+// One step for each task whose client has room for more output. A finished
+// task hands its client back to the ready queue if input is waiting.
+void Server::runTasks(Reactor& reactor) {
+    for (size_t n = reactor.tasks.size(); n > 0; --n) {
+        FdRef ref = reactor.tasks.pop();
+        ClientInfo* client = reactor.clients.find(ref.fd, ref.generation);
+        // removeClient deletes the task of a client that goes away
+        if (client == NULL || client->task == NULL || client->closing) continue;
+        if (!outputBacklogged(*client)) {
+            MutexGuard lock(_stateLock, reactor.metrics);
+            bool more = client->task->step(*this, ref.fd);
+            reactor.scratch.reset();
+            if (!more) {
+                delete client->task;
+                client->task = NULL;
+                if (client->inputPending || client->readable) {
+                    enqueueReady(reactor, *client);
+                }
+                continue;
+            }
+        }
+        reactor.tasks.push(ref);
+    }
+}
+
+void ClientTimer::expire(Server& server) {
+    server.clientTimerExpired(_client, _kind);
+}
+
+// Runs on the owning reactor with the state lock held. The keepalive timer
+// first enforces the registration deadline; after that it sleeps until the
+// client has been silent for pingInterval, sends PING, and drops the client
+// if nothing at all arrives within pingTimeout. Input only stamps lastInput,
+// the timer catches up when it fires.
+void Server::clientTimerExpired(ClientInfo& client, ClientTimer::Kind kind) {
+    Reactor& reactor = *t_reactor;
+    if (client.closing) return;
+    if (kind == ClientTimer::THROTTLE) {
+        client.throttledUntil = 0;
+        __atomic_sub_fetch(&_throttledClients, 1, __ATOMIC_RELAXED);
+        updateInterest(reactor, client);
+        enqueueReady(reactor, client);
         return;
     }
-    
-    ClientInfo& client = _clients[fd];
-    
-    // Protect against buffer overflow
-    const size_t MAX_BUFFER_SIZE = 8192; // 8KB limit
-    if (client.buffer.length() + nbytes > MAX_BUFFER_SIZE) {
-        std::cerr << "Buffer overflow protection: Client " << fd << " exceeded buffer limit" << std::endl;
-        removeClient(fd);
+
+    if (!client.registered) {
+        markClosing(reactor, client, DISCONNECT_REGISTRATION_TIMEOUT, "Registration timed out");
         return;
     }
-    
-    client.buffer += buffer;
+    long interval = static_cast<long>(_config.pingInterval) * 1000;
+    if (client.pingSent) {
+        std::ostringstream reason;
+        reason << "Ping timeout: " << _config.pingTimeout << " seconds";
+        markClosing(reactor, client, DISCONNECT_PING_TIMEOUT, reason.str());
+        return;
+    }
+    long idle = reactor.nowMs - client.lastInput;
+    if (idle < interval) {
+        reactor.timers.schedule(client.keepalive, reactor.nowMs, interval - idle);
+        return;
+    }
+    ReplyBuilder ping(reactor.scratch);
+    ping.append("PING :").append(SERVER_NAME);
+    sendReply(client.fd, ping);
+    client.pingSent = true;
+    reactor.timers.schedule(client.keepalive, reactor.nowMs, static_cast<long>(_config.pingTimeout) * 1000);
+}
+
+// Token bucket: credit refills at floodRate units per second up to
+// floodBurst, and each command spends its table cost. Without enough credit
+// the line is left unprocessed and the client is throttled until the
+// credit is there. Called with the state lock held.
+bool Server::admitCommand(ClientInfo& client, unsigned int cost) {
+    if (_config.floodRate == 0 || cost == 0 || (client.oper && _config.operFloodExempt)) return true;
+    long rate = static_cast<long>(_config.floodRate);
+    long capacity = static_cast<long>(_config.floodBurst) * 1000;
+    long now = monotonicNs() / 1000000;
+    // Units per second are thousandths per millisecond
+    client.floodTokens = std::min(capacity, client.floodTokens + (now - client.floodStamp) * rate);
+    client.floodStamp = now;
+    // A command dearer than the whole bucket runs whenever the bucket is full
+    long price = std::min(static_cast<long>(cost) * 1000, capacity);
+    if (client.floodTokens >= price) {
+        client.floodTokens -= price;
+        return true;
+    }
+    client.throttledUntil = now + (price - client.floodTokens + rate - 1) / rate;
+    __atomic_add_fetch(&_throttleEvents, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&_throttledClients, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+void Server::collectMetrics(MetricsSnapshot& snapshot) {
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        snapshot.add(_reactors[i]->metrics);
+    }
+    for (size_t i = 0; i < commandTableSize(); ++i) {
+        snapshot.commandNames.push_back(commandAt(i).name);
+    }
+    snapshot.commandNames.push_back("unknown");
+    snapshot.clients = _clients.size();
+    snapshot.channels = _channels.size();
+    snapshot.throttleEvents = throttleEvents();
+    snapshot.throttledClients = throttledClients();
+    snapshot.logDropped = Logger::dropped();
+    snapshot.uptimeSeconds = static_cast<unsigned long>((monotonicNs() - _startedNs) / 1000000000L);
+}
+
+void Server::renderMetrics(std::string& out) {
+    MetricsSnapshot snapshot;
+    {
+        MutexGuard lock(_stateLock);
+        collectMetrics(snapshot);
+    }
+    snapshot.writePrometheus(out);
+}
+
+// True when runScheduled could make progress without waiting for an event.
+// Only reads this reactor's tables and its own clients' transport state,
+// never the shared arena, so it needs no lock.
+bool Server::hasRunnableWork(Reactor& reactor) {
+    if (!reactor.ready.empty()) return true;
+    for (size_t i = 0; i < reactor.tasks.size(); ++i) {
+        ClientInfo* client = reactor.clients.find(reactor.tasks[i].fd, reactor.tasks[i].generation);
+        if (client != NULL && client->task != NULL && !outputBacklogged(*client)) return true;
+    }
+    return false;
+}
+
+// Frame and dispatch every complete line in a freshly received chunk. Lines
+// are handed to processMessage in place, straight out of the receive buffer
+// (or out of the client's carry-over buffer when a partial line was pending);
+// only an unterminated tail is copied. At most quota lines are dispatched,
+// and none once a task has started; the rest is kept in inbuf with
+// inputPending set. With no chunk, only the kept lines are looked at.
+// Returns false once the client has been removed or marked for removal.
+// Called with the state lock held.
+bool Server::processInput(Reactor& reactor, int fd, const char* chunk, size_t n, size_t& quota) {
+    // Check if client still exists (might have been removed)
+    ClientInfo* found = reactor.clients.find(fd);
+    if (found == NULL || found->closing) {
+        return false;
+    }
+    ClientInfo& client = *found;
+    InputBuffer& in = client.inbuf;
+
+    const char* data = chunk;
+    size_t avail = n;
+    if (!in.empty()) {
+        if (n > 0) in.append(chunk, n);
+        data = in.data();
+        avail = in.size();
+    }
 
     // Process complete messages (ending with \r\n or \n)
-    size_t pos;
-    while ((pos = client.buffer.find("\n")) != std::string::npos) {
-        // Check if client still exists before processing
-        if (_clients.find(fd) == _clients.end()) {
-            return;
+    size_t pos = 0;
+    while (pos < avail) {
+        if (quota == 0 || client.task != NULL || client.throttledUntil != 0) {
+            client.inputPending = true;
+            break;
+        }
+        // One vectorized pass finds the terminator and any NUL byte before it
+        bool hasNul;
+        const char* line = data + pos;
+        size_t len = scanLine(line, avail - pos, hasNul);
+        if (len == avail - pos) {
+            break;
+        }
+        size_t start = pos;
+        pos += len + 1;
+
+        // Tail of a line that was already rejected as too long
+        if (client.discardInput) {
+            client.discardInput = false;
+            continue;
+        }
+        // NUL is not allowed anywhere in an IRC line, drop the whole line
+        if (hasNul) {
+            continue;
         }
-        
-        std::string message = client.buffer.substr(0, pos);
-        client.buffer.erase(0, pos + 1);
-        
+
         // Remove \r if present before \n
-        if (!message.empty() && message[message.length() - 1] == '\r') {
-            message = message.substr(0, message.length() - 1);
-        }
-        
-        if (!message.empty()) {
-            std::cout << "Received message: [" << message << "]" << std::endl;
-            processMessage(fd, message);
-            
-            // Check again if client still exists after processing message
-            // (processMessage might call handleQuit which removes the client)
-            if (_clients.find(fd) == _clients.end()) {
-                return;
-            }
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+        // A line flood control held back comes round again, record it once
+        if (_capture != NULL) {
+            if (!client.heldLineCaptured) _capture->line(client.id, line, len);
+            client.heldLineCaptured = false;
+        }
+        if (isLineTooLong(line, len)) {
+            sendNumeric(fd, ERR_INPUTTOOLONG);
+            reactor.scratch.reset();
+            continue;
+        }
+
+        LOG_CLIENT_DEBUG(client.traceLimit, reactor.nowMs,
+                         "Received message from fd " << fd << ": [" << LogText(line, len) << "]");
+        if (!processMessage(fd, line, len)) {
+            // Out of flood-control credit: keep this line and the rest
+            pos = start;
+            client.inputPending = true;
+            client.heldLineCaptured = _capture != NULL;
+            break;
+        }
+        --quota;
+
+        // Check again if client still exists after processing message
+        // (processMessage might call handleQuit which removes the client)
+        if (reactor.clients.find(fd) != &client || client.closing) {
+            return false;
         }
     }
-}
 
-void Server::removeClient(int fd) {
-    std::map<int, ClientInfo>::iterator client_it = _clients.find(fd);
-    if (client_it == _clients.end()) {
-        close(fd);
-        for (size_t i = 0; i < _fds.size(); ++i) {
-            if (_fds[i].fd == fd) {
-                _fds.erase(_fds.begin() + i);
-                break;
-            }
+    // An unterminated line longer than any valid one is dropped up to its newline
+    if (!client.inputPending && avail - pos > MAX_LINE_LENGTH) {
+        if (!client.discardInput) {
+            sendNumeric(fd, ERR_INPUTTOOLONG);
+            reactor.scratch.reset();
+            client.discardInput = true;
         }
+        pos = avail;
+    }
+
+    // Keep the unterminated tail for the next read
+    if (data == chunk) {
+        if (pos < avail) {
+            in.append(chunk + pos, avail - pos);
+        }
+    } else {
+        in.consume(pos);
+    }
+    return true;
+}
+
+void Server::removeClient(int fd, DisconnectReason kind, const std::string& reason) {
+    ClientInfo* found = _clients.find(fd);
+    if (found == NULL) {
         return;
     }
     
-    ClientInfo& client = client_it->second;
+    ClientInfo& client = *found;
+    // Sockets are only ever closed by the thread that owns them
+    Reactor& owner = *_reactors[client.owner];
+    if (t_reactor != &owner) {
+        postClose(client, kind, reason);
+        return;
+    }
+    bumpCounter(owner.metrics.disconnects[kind]);
+    if (_capture != NULL) _capture->disconnect(client.id);
+    if (client.nickId != NO_SYMBOL) {
+        _nickOwner[client.nickId] = -1;
+        _symbols.release(client.nickId);
+    }
     
     // Only send QUIT message if client was registered
     if (client.registered && !client.nickname.empty()) {
-        std::string quit_msg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " QUIT :Client disconnected\r\n";
-        for (std::set<std::string>::iterator it = client.channels.begin(); 
-             it != client.channels.end(); ++it) {
-            broadcastToChannel(*it, quit_msg, fd);
-            _channels[*it].members.erase(fd);
-            _channels[*it].operators.erase(fd);
-            if (_channels[*it].members.empty()) {
-                _channels.erase(*it);
-            }
+        ReplyBuilder line(owner.scratch);
+        line.append(client.prefix).append(" QUIT :").append(reason);
+        MessageRef quit_msg(line.finish());
+        // leaveChannel shrinks client.channels, so walk it from the back
+        while (!client.channels.empty()) {
+            ChannelInfo& channel = *_channels.get(client.channels.back());
+            broadcastToChannel(channel, quit_msg.get(), fd);
+            leaveChannel(fd, channel);
         }
     }
     
-    close(fd);
-    _clients.erase(fd);
+    // Best effort: hand the kernel whatever replies are still queued
+    if (!client.closing && client.pendingOutput() > 0) {
+        flushClient(client);
+    }
     
-    for (size_t i = 0; i < _fds.size(); ++i) {
-        if (_fds[i].fd == fd) {
-            _fds.erase(_fds.begin() + i);
-            break;
-        }
+    owner.metrics.adjustSendq(client.pendingOutput(), 0);
+    delete client.task;
+    client.task = NULL;
+    if (client.throttledUntil != 0) {
+        __atomic_sub_fetch(&_throttledClients, 1, __ATOMIC_RELAXED);
     }
+    owner.poller->remove(fd);
+    close(fd);
+    owner.clients.erase(fd);
+    _clients.release(fd);
 }
 
-void Server::processMessage(int fd, const std::string& message) {
-    std::vector<std::string> tokens = parseMessage(message);
-    if (tokens.empty()) return;
-
-    std::string command = tokens[0];
-    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
-    std::vector<std::string> params(tokens.begin() + 1, tokens.end());
-
-    // Handle IRC commands
-    if (command == "PASS") {
-        ::handlePass(this, fd, params);
-    } else if (command == "NICK") {
-        ::handleNick(this, fd, params);
-    } else if (command == "USER") {
-        ::handleUser(this, fd, params);
-    } else if (command == "JOIN") {
-        ::handleJoin(this, fd, params);
-    } else if (command == "PRIVMSG") {
-        ::handlePrivMsg(this, fd, params);
-    } else if (command == "QUIT") {
-        ::handleQuit(this, fd, params);
-    } else if (command == "PING") {
-        ::handlePing(this, fd, params);
-    } else if (command == "PART") {
-        ::handlePart(this, fd, params);
-    } else if (command == "MODE") {
-        ::handleMode(this, fd, params);
-    } else if (command == "WHO") {
-        ::handleWho(this, fd, params);
-    } else if (command == "LIST") {
-        ::handleList(this, fd, params);
-    } else if (command == "KICK") {
-        ::handleKick(this, fd, params);
-    } else if (command == "INVITE") {
-        ::handleInvite(this, fd, params);
-    } else if (command == "CAP") {
-        // CAP (Client Capability) command for modern IRC clients like irssi
-        if (!params.empty()) {
-            std::string subcmd = params[0];
-            std::transform(subcmd.begin(), subcmd.end(), subcmd.begin(), ::toupper);
-            if (subcmd == "LS") {
-                sendReply(fd, "CAP * LS :\r\n");
-            } else if (subcmd == "END") {
-                // No response needed for CAP END
-            } else if (subcmd == "REQ") {
-                // Client requesting capabilities - we don't support any
-                sendReply(fd, "CAP * NAK\r\n");
-            }
-        }
-    } else if (command == "TOPIC") {
-        ClientInfo& client = _clients[fd];
-        if (!client.registered) {
-            sendReply(fd, formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-            return;
-        }
-        if (params.empty()) {
-            sendReply(fd, formatServerReply(fd, "461 " + client.nickname + " TOPIC :Not enough parameters"));
-            return;
-        }
-        std::string channel = params[0];
-        
-        // Check if channel exists
-        if (_channels.find(channel) == _channels.end()) {
-            sendReply(fd, formatServerReply(fd, "403 " + client.nickname + " " + channel + " :No such channel"));
-            return;
+// Defer removal to the end of the loop iteration, so it is safe to call while
+// iterating channel members (e.g. from sendReply during a broadcast)
+void Server::markForDisconnect(int fd, const std::string& reason) {
+    ClientInfo* client = _clients.find(fd);
+    if (client == NULL) return;
+    if (t_reactor == NULL || client->owner != t_reactor->index) {
+        postClose(*client, DISCONNECT_OTHER, reason);
+        return;
+    }
+    markClosing(*t_reactor, *client, DISCONNECT_OTHER, reason);
+}
+
+// Hands a removal to the thread that owns the client, which marks it
+// closing when it next delivers its mail. Any thread, state lock held.
+void Server::postClose(ClientInfo& client, DisconnectReason kind, const std::string& reason) {
+    MailItem* item = new MailItem();
+    item->close = true;
+    item->closeKind = kind;
+    item->closeReason = reason;
+    item->targets.push_back(std::make_pair(client.fd, client.id));
+    Reactor& owner = *_reactors[client.owner];
+    owner.mailbox.push(item);
+    owner.wake();
+}
+
+void Server::markClosing(Reactor& reactor, ClientInfo& client, DisconnectReason kind, const std::string& reason) {
+    if (client.closing) return;
+    client.closing = true;
+    client.closeReason = reason;
+    client.closeKind = kind;
+    reactor.pendingClose.push_back(FdRef(client.fd, reactor.clients.generation(client.fd)));
+}
+
+// Called with the state lock held
+void Server::reapClients(Reactor& reactor) {
+    // Removing a client broadcasts QUIT, which may mark more clients
+    while (!reactor.pendingClose.empty()) {
+        std::vector<FdRef> batch;
+        batch.swap(reactor.pendingClose);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            // Skips entries whose client is already gone, even if the fd was reused
+            ClientInfo* client = reactor.clients.find(batch[i].fd, batch[i].generation);
+            if (client == NULL) continue;
+            LOG_WARN("Dropping client fd " << batch[i].fd << ": " << client->closeReason);
+            std::string reason = client->closeReason;
+            removeClient(batch[i].fd, client->closeKind, reason);
         }
-        
-        ChannelInfo& chanInfo = _channels[channel];
-        
-        // Check if user is in the channel
-        if (chanInfo.members.find(fd) == chanInfo.members.end()) {
-            sendReply(fd, formatServerReply(fd, "442 " + client.nickname + " " + channel + " :You're not on that channel"));
-            return;
+    }
+}
+
+const MessageView& Server::currentMessage() const {
+    return t_reactor->message;
+}
+
+// Returns false when flood control deferred the line, which then stays
+// unprocessed. Called with the state lock held, on the thread that owns fd.
+bool Server::processMessage(int fd, const char* line, size_t len) {
+    MessageView& message = t_reactor->message;
+    if (!parseMessageView(line, len, message)) return true;
+
+    const CommandEntry* command = findCommand(message.data(message.command), message.command.length);
+    ClientInfo& client = *_clients.find(fd);
+    // Unknown commands are charged too, so junk cannot flood 421s
+    if (!admitCommand(client, command != NULL ? command->cost : 1)) return false;
+    ReactorMetrics& metrics = t_reactor->metrics;
+    size_t slot = command != NULL ? commandIndex(command) : commandTableSize();
+    bumpCounter(metrics.commands[slot]);
+    if (command == NULL) {
+        std::string upper = message.str(message.command);
+        std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        sendNumeric(fd, ERR_UNKNOWNCOMMAND, upper);
+        return true;
+    }
+
+    // Checks shared by every command, driven by the table entry
+    if (command->needsRegistration && !client.registered) {
+        sendNumeric(fd, ERR_NOTREGISTERED);
+        return true;
+    }
+    if (message.paramCount < command->minParams) {
+        sendNumeric(fd, ERR_NEEDMOREPARAMS, command->name);
+        return true;
+    }
+
+    // Parameter strings are swapped in from persistent storage and back out
+    // after the handler, so they keep their capacity and filling them does
+    // not allocate once the server has warmed up
+    std::vector<std::string>& params = t_reactor->params;
+    std::string* storage = t_reactor->paramStorage;
+    size_t count = message.paramCount;
+    params.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        params[i].swap(storage[i]);
+        params[i].assign(message.paramData(i), message.paramLength(i));
+    }
+
+    long started = monotonicNs();
+    command->handler(this, fd, params);
+    metrics.latency[slot].record(static_cast<unsigned long>(monotonicNs() - started));
+
+    for (size_t i = 0; i < count && i < params.size(); ++i) {
+        params[i].swap(storage[i]);
+    }
+    // Replies built by the handler are all SharedMessages by now
+    t_reactor->scratch.reset();
+    return true;
+}
+
+void Server::sendReply(int fd, const std::string& reply) {
+    MessageRef msg(SharedMessage::create(reply));
+    sendMessage(fd, msg.get());
+}
+
+void Server::sendReply(int fd, ReplyBuilder& reply) {
+    MessageRef msg(reply.finish());
+    sendMessage(fd, msg.get());
+}
+
+BumpArena& Server::scratch() {
+    return t_reactor->scratch;
+}
+
+// Queue a shared message by reference; the caller keeps its own reference.
+// Called with the state lock held.
+void Server::sendMessage(int fd, SharedMessage* msg) {
+    ClientInfo* found = _clients.find(fd);
+    if (found == NULL) return;
+    ClientInfo& client = *found;
+
+    if (client.owner == t_reactor->index) {
+        queueOutput(*t_reactor, client, msg);
+        return;
+    }
+    // Another thread owns the socket, hand the message over
+    MailItem* item = new MailItem();
+    msg->retain();
+    item->msg = MessageRef(msg);
+    item->targets.push_back(std::make_pair(fd, client.id));
+    Reactor& owner = *_reactors[client.owner];
+    owner.mailbox.push(item);
+    owner.wake();
+}
+
+// Owner thread only. The socket is written once per loop iteration by
+// flushDirty, so a burst of replies goes out in as few writev calls as it can.
+void Server::queueOutput(Reactor& reactor, ClientInfo& client, SharedMessage* msg) {
+    if (client.closing) return;
+
+    size_t before = client.pendingOutput();
+    client.sendq.push(msg);
+    reactor.metrics.adjustSendq(before, client.pendingOutput());
+    bumpCounter(reactor.metrics.messagesOut);
+    if (client.pendingOutput() > _config.sendQueueMax) {
+        // Only what the kernel refuses counts against the limit, so give it
+        // a chance before deciding the client cannot keep up
+        if (client.wantWrite || !flushClient(client)
+            || client.pendingOutput() > _config.sendQueueMax) {
+            markClosing(reactor, client, DISCONNECT_SENDQ, "SendQ exceeded");
         }
-        
-        if (params.size() > 1) {
-            // Set topic
-            // Check if topic is restricted to operators (+t mode)
-            if (chanInfo.topicRestricted) {
-                // Only operators can set the topic when +t is enabled
-                if (chanInfo.operators.find(fd) == chanInfo.operators.end()) {
-                    sendReply(fd, formatServerReply(fd, "482 " + client.nickname + " " + channel + " :You're not channel operator"));
-                    return;
-                }
-            }
-            
-            // Set the new topic
-            std::string newTopic = params[1];
-            chanInfo.topic = newTopic;
-            
-            // Broadcast topic change to all channel members
-            std::string topicMsg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " TOPIC " + channel + " :" + newTopic + "\r\n";
-            broadcastToChannel(channel, topicMsg, -1);
-        } else {
-            // Get topic
-            if (chanInfo.topic.empty()) {
-                sendReply(fd, formatServerReply(fd, "331 " + client.nickname + " " + channel + " :No topic is set"));
+        return;
+    }
+    if (!client.flushQueued && !client.wantWrite) {
+        client.flushQueued = true;
+        reactor.dirty.push_back(FdRef(client.fd, reactor.clients.generation(client.fd)));
+    }
+}
+
+void Server::deliverMail(Reactor& reactor) {
+    MailItem* item;
+    while ((item = reactor.mailbox.pop()) != NULL) {
+        for (size_t i = 0; i < item->targets.size(); ++i) {
+            ClientInfo* client = reactor.clients.find(item->targets[i].first);
+            // Skip recipients that left, or whose fd was reused since
+            if (client == NULL || client->id != item->targets[i].second) continue;
+            if (item->close) {
+                markClosing(reactor, *client, item->closeKind, item->closeReason);
             } else {
-                sendReply(fd, formatServerReply(fd, "332 " + client.nickname + " " + channel + " :" + chanInfo.topic));
+                queueOutput(reactor, *client, item->msg.get());
             }
         }
-    } else if (command == "NAMES") {
-        // Handle NAMES command  
-        ClientInfo& client = _clients[fd];
-        if (!client.registered) {
-            sendReply(fd, formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-            return;
-        }
-        if (!params.empty()) {
-            std::string channel = params[0];
-            if (_channels.find(channel) != _channels.end()) {
-                std::string names = "";
-                for (std::set<int>::iterator it = _channels[channel].members.begin(); 
-                     it != _channels[channel].members.end(); ++it) {
-                    if (!names.empty()) names += " ";
-                    // Add @ prefix for operators
-                    if (_channels[channel].operators.find(*it) != _channels[channel].operators.end()) {
-                        names += "@";
-                    }
-                    names += _clients[*it].nickname;
-                }
-                sendReply(fd, formatServerReply(fd, "353 " + client.nickname + " = " + channel + " :" + names));
-            }
-            sendReply(fd, formatServerReply(fd, "366 " + client.nickname + " " + channel + " :End of NAMES list"));
-        }
-    } else if (command == "WHOIS") {
-        // Handle WHOIS command - show user information
-        ClientInfo& client = _clients[fd];
-        if (!client.registered) {
-            sendReply(fd, formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-            return;
-        }
-        if (params.empty()) {
-            sendReply(fd, formatServerReply(fd, "431 " + client.nickname + " :No nickname given"));
-            return;
-        }
-        std::string target_nick = params[0];
-        bool found = false;
-        for (std::map<int, ClientInfo>::iterator it = _clients.begin(); 
-             it != _clients.end(); ++it) {
-            if (it->second.nickname == target_nick) {
-                ClientInfo& target = it->second;
-                sendReply(fd, formatServerReply(fd, "311 " + client.nickname + " " + target.nickname + " " + 
-                         target.username + " " + target.hostname + " * :" + target.realname));
-                // List channels the user is in
-                if (!target.channels.empty()) {
-                    std::string channels_list = "";
-                    for (std::set<std::string>::iterator ch_it = target.channels.begin();
-                         ch_it != target.channels.end(); ++ch_it) {
-                        if (!channels_list.empty()) channels_list += " ";
-                        channels_list += *ch_it;
-                    }
-                    sendReply(fd, formatServerReply(fd, "319 " + client.nickname + " " + target.nickname + " :" + channels_list));
-                }
-                sendReply(fd, formatServerReply(fd, "312 " + client.nickname + " " + target.nickname + " " + SERVER_NAME + " :IRC Server"));
-                sendReply(fd, formatServerReply(fd, "318 " + client.nickname + " " + target.nickname + " :End of WHOIS list"));
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            sendReply(fd, formatServerReply(fd, "401 " + client.nickname + " " + target_nick + " :No such nick/channel"));
-            sendReply(fd, formatServerReply(fd, "318 " + client.nickname + " " + target_nick + " :End of WHOIS list"));
-        }
-    } else if (command == "USERHOST") {
-        // Handle USERHOST command - return user@host for given nicknames
-        ClientInfo& client = _clients[fd];
-        if (!client.registered) {
-            sendReply(fd, formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-            return;
-        }
-        std::string response = "302 " + client.nickname + " :";
-        for (size_t i = 0; i < params.size(); ++i) {
-            for (std::map<int, ClientInfo>::iterator it = _clients.begin(); 
-                 it != _clients.end(); ++it) {
-                if (it->second.nickname == params[i]) {
-                    if (i > 0) response += " ";
-                    response += it->second.nickname + "=+" + it->second.username + "@" + it->second.hostname;
-                    break;
-                }
-            }
-        }
-        sendReply(fd, formatServerReply(fd, response));
-    } else {
-        ClientInfo& client = _clients[fd];
-        sendReply(fd, formatServerReply(fd, "421 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " " + command + " :Unknown command"));
+        delete item;
     }
 }
 
-void Server::sendReply(int fd, const std::string& reply) {
-    size_t total_sent = 0;
-    size_t len = reply.length();
-    const char* data = reply.c_str();
-    
-    while (total_sent < len) {
-        ssize_t sent = send(fd, data + total_sent, len - total_sent, 0);
+void Server::flushDirty(Reactor& reactor) {
+    if (reactor.dirty.empty()) return;
+    std::vector<FdRef> batch;
+    batch.swap(reactor.dirty);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ClientInfo* found = reactor.clients.find(batch[i].fd, batch[i].generation);
+        if (found == NULL) continue;
+        ClientInfo& client = *found;
+        client.flushQueued = false;
+        // Clients waiting for writability are flushed by handleClientWrite
+        if (client.closing || client.wantWrite) continue;
+        flushClient(client);
+    }
+    batch.clear();
+    // Hand the vector back so its capacity is reused next iteration
+    if (reactor.dirty.empty()) batch.swap(reactor.dirty);
+}
+
+void Server::handleClientWrite(Reactor& reactor, int fd) {
+    ClientInfo* client = reactor.clients.find(fd);
+    if (client == NULL || client->closing) return;
+    flushClient(*client);
+}
+
+// Write queued output until the socket would block. Returns false (and marks
+// the client for removal) on a fatal send error. Owner thread only.
+bool Server::flushClient(ClientInfo& client) {
+    Reactor& reactor = *_reactors[client.owner];
+    while (!client.sendq.empty()) {
+        size_t before = client.pendingOutput();
+        ssize_t sent = client.sendq.writeTo(client.fd);
         if (sent < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // Socket buffer full, wait a bit and retry
-                continue;
-            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
             // Actual error - client may have disconnected
-            // std::cerr << "Error sending to client " << fd << ": " << strerror(errno) << std::endl;
-            return;
+            markClosing(reactor, client, DISCONNECT_WRITE_ERROR, "Write error");
+            return false;
         }
-        total_sent += sent;
+        reactor.metrics.adjustSendq(before, client.pendingOutput());
+        bumpCounter(reactor.metrics.bytesOut, static_cast<unsigned long>(sent));
     }
+
+    // Only ask for writability while something is actually queued
+    bool pending = client.pendingOutput() > 0;
+    if (pending != client.wantWrite) {
+        client.wantWrite = pending;
+        updateInterest(reactor, client);
+    }
+    return true;
+}
+
+// Read interest is dropped while the client is throttled: its unread input
+// stays in the kernel, and poll() would report it on every iteration
+void Server::updateInterest(Reactor& reactor, ClientInfo& client) {
+    int events = client.wantWrite ? Poller::EV_WRITE : 0;
+    if (client.throttledUntil == 0) events |= Poller::EV_READ;
+    reactor.poller->modify(client.fd, events);
 }
 
 void Server::broadcastToChannel(const std::string& channel, const std::string& message, int exclude_fd) {
-    std::map<std::string, ChannelInfo>::iterator it = _channels.find(channel);
-    if (it != _channels.end()) {
-        for (std::set<int>::iterator client_it = it->second.members.begin(); 
-             client_it != it->second.members.end(); ++client_it) {
-            if (*client_it != exclude_fd) {
-                sendReply(*client_it, message);
+    ChannelInfo* found = _channels.find(channel);
+    if (found != NULL) {
+        broadcastToChannel(*found, message, exclude_fd);
+    }
+}
+
+void Server::broadcastToChannel(const ChannelInfo& channel, const std::string& message, int exclude_fd) {
+    MessageRef msg(SharedMessage::create(message));
+    broadcastToChannel(channel, msg.get(), exclude_fd);
+}
+
+// One buffer for the whole channel, each member queues a reference to it.
+// Called with the state lock held; the caller keeps its own reference.
+void Server::broadcastToChannel(const ChannelInfo& channel, SharedMessage* msg, int exclude_fd) {
+    Reactor& self = *t_reactor;
+    const std::vector<ChannelMember>& members = channel.members;
+    for (size_t i = 0; i < members.size(); ++i) {
+        int fd = members[i].fd;
+        if (fd == exclude_fd) continue;
+        ClientInfo* client = _clients.find(fd);
+        if (client == NULL) continue;
+        if (client->owner == self.index) {
+            queueOutput(self, *client, msg);
+            continue;
+        }
+        // Members on other threads are batched, one mail item per thread
+        MailItem*& item = self.outbox[client->owner];
+        if (item == NULL) {
+            item = new MailItem();
+            msg->retain();
+            item->msg = MessageRef(msg);
+        }
+        item->targets.push_back(std::make_pair(fd, client->id));
+    }
+    for (size_t i = 0; i < self.outbox.size(); ++i) {
+        if (self.outbox[i] == NULL) continue;
+        _reactors[i]->mailbox.push(self.outbox[i]);
+        _reactors[i]->wake();
+        self.outbox[i] = NULL;
+    }
+}
+
+void Server::sendNumeric(int fd, NumericId id, const NumericArg& a, const NumericArg& b,
+                         const NumericArg& c, const NumericArg& d, const NumericArg& e) {
+    ClientInfo* client = _clients.find(fd);
+    if (client == NULL) return;
+    const NumericArg* args[NumericFormatter::MAX_ARGS] = { &a, &b, &c, &d, &e };
+    ReplyBuilder reply(scratch());
+    _numerics.format(reply, id, client->nickname, args, NumericFormatter::MAX_ARGS);
+    sendReply(fd, reply);
+}
+
+void Server::sendNames(int fd, ChannelInfo* channel, const std::string& name) {
+    ClientInfo* client = _clients.find(fd);
+    if (client == NULL) return;
+    if (channel != NULL && !channel->members.empty()) {
+        const std::string& names = channelNames(*channel);
+        // Format the line once with an empty list; every chunk reuses that head
+        NumericArg chan(name);
+        NumericArg none;
+        const NumericArg* args[] = { &chan, &none };
+        ReplyBuilder line(scratch());
+        _numerics.format(line, RPL_NAMREPLY, client->nickname, args, 2);
+        size_t head = line.length();
+        size_t budget = MAX_MESSAGE_LENGTH - 2 > head ? MAX_MESSAGE_LENGTH - 2 - head : 1;
+
+        size_t start = 0;
+        while (start < names.length()) {
+            size_t end = names.length();
+            if (end - start > budget) {
+                // Break at the last space that keeps the line in budget; a
+                // single name longer than the budget goes out on its own
+                end = names.rfind(' ', start + budget);
+                if (end == std::string::npos || end <= start) {
+                    end = names.find(' ', start);
+                    if (end == std::string::npos) end = names.length();
+                }
             }
+            line.truncate(head);
+            line.append(names.data() + start, end - start);
+            sendReply(fd, line);
+            start = end + 1;
         }
     }
+    sendNumeric(fd, RPL_ENDOFNAMES, name);
 }
 
-// Format server numeric reply with proper prefix
-std::string Server::formatServerReply(int fd, const std::string& numericAndParams) const {
-    std::string nick = "*";
-    std::map<int, ClientInfo>::const_iterator it = _clients.find(fd);
-    if (it != _clients.end() && !it->second.nickname.empty()) {
-        nick = it->second.nickname;
+// Rebuilt from the member list only after invalidateNames(), so repeated
+// NAMES and joins without membership changes reuse the same text
+const std::string& Server::channelNames(ChannelInfo& channel) {
+    if (channel.namesValid) return channel.names;
+    std::string& names = channel.names;
+    names.clear();
+    for (size_t i = 0; i < channel.members.size(); ++i) {
+        const ChannelMember& member = channel.members[i];
+        if (i > 0) names += ' ';
+        if (member.modes & MEMBER_OP) {
+            names += '@';
+        } else if (member.modes & MEMBER_VOICE) {
+            names += '+';
+        }
+        names += _clients.find(member.fd)->nickname;
     }
-    return ":" + SERVER_NAME + " " + numericAndParams + "\r\n";
+    channel.namesValid = true;
+    return names;
 }
 
 // Format user message with proper hostmask prefix
 std::string Server::formatUserMessage(int fd, const std::string& command) const {
-    std::map<int, ClientInfo>::const_iterator it = _clients.find(fd);
-    if (it != _clients.end()) {
-        return ":" + it->second.nickname + "!" + it->second.username + "@" + it->second.hostname + " " + command + "\r\n";
+    const ClientInfo* client = _clients.find(fd);
+    if (client != NULL) {
+        return client->prefix + " " + command + "\r\n";
     }
     return ":" + SERVER_NAME + " " + command + "\r\n";
 }
 
 // Helper function: Check if a client is a channel operator
 bool Server::isChannelOperator(const std::string& channel, int fd) {
-    std::map<std::string, ChannelInfo>::iterator it = _channels.find(channel);
-    if (it == _channels.end()) return false;
-    return it->second.operators.find(fd) != it->second.operators.end();
+    ChannelInfo* found = _channels.find(channel);
+    return found != NULL && found->isOperator(fd);
 }
 
 // Helper function: Check if a client is in a channel
 bool Server::isClientInChannel(const std::string& channel, int fd) {
-    std::map<std::string, ChannelInfo>::iterator it = _channels.find(channel);
-    if (it == _channels.end()) return false;
-    return it->second.members.find(fd) != it->second.members.end();
+    ChannelInfo* found = _channels.find(channel);
+    return found != NULL && found->hasMember(fd);
 }
 
 // Helper function: Get client fd by nickname
 int Server::getClientFdByNick(const std::string& nickname) {
-    for (std::map<int, ClientInfo>::iterator it = _clients.begin(); 
-         it != _clients.end(); ++it) {
-        if (it->second.nickname == nickname) {
-            return it->first;
-        }
+    SymbolId symbol = _symbols.find(nickname);
+    return symbol < _nickOwner.size() ? _nickOwner[symbol] : -1;
+}
+
+// Helper function: Change a client's nickname and keep the index in sync
+void Server::setNickname(int fd, const std::string& nickname) {
+    ClientInfo& client = *_clients.find(fd);
+    // Intern first: a case-only change keeps the same symbol alive
+    SymbolId symbol = _symbols.intern(nickname);
+    if (client.nickId != NO_SYMBOL) {
+        _nickOwner[client.nickId] = -1;
+        _symbols.release(client.nickId);
+    }
+    if (_nickOwner.size() <= symbol) {
+        _nickOwner.resize(symbol + 1, -1);
+    }
+    _nickOwner[symbol] = fd;
+    client.nickId = symbol;
+    client.nickname = nickname;
+    client.updatePrefix();
+    for (size_t i = 0; i < client.channels.size(); ++i) {
+        _channels.get(client.channels[i])->invalidateNames();
     }
-    return -1;
 }
 
-// Helper function: Get client by fd
-ClientInfo& Server::getClient(int fd) {
-    return _clients[fd];
+// Helper function: Add a client to a channel, creating it on first join.
+// The creator becomes its operator.
+ChannelInfo& Server::joinChannel(int fd, const std::string& name) {
+    ChannelInfo* channel = _channels.find(name);
+    if (channel == NULL) {
+        channel = &_channels.create(name);
+    }
+    if (channel->addMember(fd, channel->members.empty() ? MEMBER_OP : 0)) {
+        _clients.find(fd)->channels.push_back(channel->id);
+        _channels.updateMemberCount(*channel);
+    }
+    return *channel;
 }
 
-// Helper function: Get channel by name
-ChannelInfo& Server::getChannel(const std::string& name) {
-    return _channels[name];
+// Helper function: Remove a client from a channel, dropping it once empty
+void Server::leaveChannel(int fd, ChannelInfo& channel) {
+    channel.removeMember(fd);
+    _channels.updateMemberCount(channel);
+    ClientInfo* client = _clients.find(fd);
+    if (client != NULL) {
+        std::vector<ChannelId>& joined = client->channels;
+        std::vector<ChannelId>::iterator it = std::find(joined.begin(), joined.end(), channel.id);
+        if (it != joined.end()) joined.erase(it);
+    }
+    if (channel.members.empty()) {
+        _channels.destroy(channel.id);
+    }
+}
+
+// Helper function: Get client by fd
+ClientInfo& Server::getClient(int fd) {
+    return *_clients.find(fd);
 }
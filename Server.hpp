@@ -9,92 +9,264 @@
 #include <cstdlib>
 #include <cerrno>
 #include <climits>
-#include <iostream>
+#include <ctime>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <stdexcept>
 #include <fcntl.h>
 #include <poll.h>
-#include <vector>
 #include <csignal>
 #include <cstring>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <cerrno>
 #include "parcer.hpp"
+#include "Poller.hpp"
+#include "OutputQueue.hpp"
+#include "NameIndex.hpp"
+#include "InputBuffer.hpp"
+#include "LineScanner.hpp"
+#include "Reactor.hpp"
+#include "Channel.hpp"
+#include "FdArena.hpp"
+#include "ReplyBuilder.hpp"
+#include "Numerics.hpp"
+#include "Task.hpp"
+#include "TimerWheel.hpp"
+#include "Logger.hpp"
+#include "Metrics.hpp"
+#include "MetricsEndpoint.hpp"
+#include "Capture.hpp"
 
-struct ChannelInfo {
-    std::set<int> members;          // Client file descriptors
-    std::set<int> operators;        // Operator file descriptors
-    std::set<int> invited;          // Invited client file descriptors (for +i mode)
-    std::string key;                // Channel password
-    size_t userLimit;               // 0 means no limit
-    bool inviteOnly;                // +i mode
-    bool topicRestricted;           // +t mode
-    std::string topic;              // Channel topic
-    
-    ChannelInfo() : userLimit(0), inviteOnly(false), topicRestricted(true) {}
-    
-    std::string getModeString() const;
+struct ClientInfo;
+
+// A deadline of one client, on its owning reactor's timer wheel
+class ClientTimer : public Timer {
+public:
+    enum Kind {
+        KEEPALIVE,                  // Registration deadline, then idle PING and ping timeout
+        THROTTLE                    // End of a flood-control wait
+    };
+
+    ClientTimer(ClientInfo& client, Kind kind) : _client(client), _kind(kind) {}
+    virtual void expire(Server& server);
+
+private:
+    ClientInfo& _client;
+    Kind _kind;
 };
 
 struct ClientInfo {
     int fd;
-    std::string buffer;
+    unsigned long id;               // Unique per connection, tells reused fds apart
+    size_t owner;                   // Index of the reactor that owns the socket
+    // Transport state below is only touched by the owning reactor's thread
+    InputBuffer inbuf;              // Unterminated input carried over between reads
+    bool discardInput;              // Dropping the rest of an over-long line
+    OutputQueue sendq;              // Outbound messages the socket has not accepted yet
+    bool wantWrite;                 // Registered for writability with the poller
+    bool flushQueued;               // Listed in the owner's dirty list
+    bool closing;                   // Scheduled for removal, no more input or output
+    bool readable;                  // Socket may hold unread input (edge-triggered)
+    bool inputPending;              // inbuf may hold complete lines a turn left over
+    bool readyQueued;               // Listed in the owner's ready queue
+    long floodTokens;               // Flood-control credit, in thousandths of a cost unit
+    long floodStamp;                // Monotonic ms the credit was last topped up
+    long throttledUntil;            // Monotonic ms input resumes, 0 when not throttled
+    long lastInput;                 // Monotonic ms of the last read that returned data
+    bool pingSent;                  // Keepalive PING outstanding, cleared by any input
+    ClientTimer keepalive;
+    ClientTimer throttle;
+    LogLimiter traceLimit;          // Caps debug lines about this client
+    std::string closeReason;
+    DisconnectReason closeKind;
+    // IRC state below is shared, guarded by the server state lock
     std::string nickname;
+    SymbolId nickId;                // Interned nickname, NO_SYMBOL until NICK
     std::string username;
     std::string realname;
     std::string hostname;
+    std::string prefix;             // ":nick!user@host", rebuilt by updatePrefix
     bool authenticated;
     bool registered;
-    std::set<std::string> channels;
+    bool oper;                      // Authenticated with OPER
+    bool heldLineCaptured;          // The line flood control held back is already recorded
+    std::vector<ChannelId> channels;  // In join order
+    Task* task;                     // Command continuation in progress, owned
     
-    ClientInfo() : fd(-1), authenticated(false), registered(false) {}
-    ClientInfo(int socket_fd) : fd(socket_fd), authenticated(false), registered(false) {}
+    ClientInfo() : fd(-1), id(0), owner(0), discardInput(false), wantWrite(false), flushQueued(false), closing(false), readable(false), inputPending(false), readyQueued(false), floodTokens(0), floodStamp(0), throttledUntil(0), lastInput(0), pingSent(false), keepalive(*this, ClientTimer::KEEPALIVE), throttle(*this, ClientTimer::THROTTLE), closeKind(DISCONNECT_OTHER), nickId(NO_SYMBOL), authenticated(false), registered(false), oper(false), heldLineCaptured(false), task(NULL) {}
+    ClientInfo(int socket_fd) : fd(socket_fd), id(0), owner(0), discardInput(false), wantWrite(false), flushQueued(false), closing(false), readable(false), inputPending(false), readyQueued(false), floodTokens(0), floodStamp(0), throttledUntil(0), lastInput(0), pingSent(false), keepalive(*this, ClientTimer::KEEPALIVE), throttle(*this, ClientTimer::THROTTLE), closeKind(DISCONNECT_OTHER), nickId(NO_SYMBOL), authenticated(false), registered(false), oper(false), heldLineCaptured(false), task(NULL) {}
+
+    size_t pendingOutput() const { return sendq.bytes(); }
+    // Call after changing nickname, username or hostname
+    void updatePrefix() { prefix = ":" + nickname + "!" + username + "@" + hostname; }
+};
+
+// Startup options, see main.cpp for the matching command line flags
+struct ServerConfig {
+    size_t sendQueueMax;            // Queued output bytes before "SendQ exceeded"
+    size_t recvBufferSize;          // Bytes requested per recv() call
+    size_t threads;                 // Event-loop threads, each with its own listener
+    int listenBacklog;              // Pending connections per listener, capped by the kernel
+    size_t floodRate;               // Command cost units regained per second, 0 disables flood control
+    size_t floodBurst;              // Cost units a client may spend back to back
+    std::string operPassword;       // OPER password, empty disables OPER
+    bool operFloodExempt;           // Operators bypass flood control
+    size_t registerTimeout;         // Seconds a connection has to complete registration
+    size_t pingInterval;            // Seconds of silence before the server sends PING
+    size_t pingTimeout;             // Seconds to wait for any input after that PING
+    LogLevel logLevel;              // Most verbose level written
+    int metricsPort;                // Loopback port for Prometheus scrapes, 0 disables
+    std::string capturePath;        // Inbound traffic recording, empty disables
+
+    ServerConfig() : sendQueueMax(1024 * 1024), recvBufferSize(16384), threads(1), listenBacklog(SOMAXCONN),
+                     floodRate(10), floodBurst(20), operFloodExempt(true),
+                     registerTimeout(60), pingInterval(120), pingTimeout(60),
+                     logLevel(LOG_LEVEL_INFO), metricsPort(0) {}
 };
 
 class Server {
 public:
-    Server(int port, const std::string &password);
+    Server(int port, const std::string &password, const ServerConfig& config = ServerConfig());
     ~Server();
 
     void run();
     
     // Public helper functions for command handlers
     std::string getPassword() const { return _password; }
+    const std::string& getOperPassword() const { return _config.operPassword; }
+    // Flood control: times a client ran out of credit, and clients whose
+    // input is held back right now
+    unsigned long throttleEvents() const { return __atomic_load_n(&_throttleEvents, __ATOMIC_RELAXED); }
+    unsigned long throttledClients() const { return __atomic_load_n(&_throttledClients, __ATOMIC_RELAXED); }
+    // Totals over every event loop; called with the state lock held
+    void collectMetrics(MetricsSnapshot& snapshot);
+    // Prometheus text for the metrics endpoint; takes the state lock
+    void renderMetrics(std::string& out);
     ClientInfo& getClient(int fd);
-    ChannelInfo& getChannel(const std::string& name);
-    std::map<int, ClientInfo>& getClients() { return _clients; }
-    std::map<std::string, ChannelInfo>& getChannels() { return _channels; }
+    ChannelInfo* findChannel(const std::string& name) { return _channels.find(name); }
+    ChannelInfo& getChannel(ChannelId id) { return *_channels.get(id); }
+    ChannelTable& getChannels() { return _channels; }
+    // Membership changes keep the channel and the client's list in step; an
+    // emptied channel is destroyed by leaveChannel
+    ChannelInfo& joinChannel(int fd, const std::string& name);
+    void leaveChannel(int fd, ChannelInfo& channel);
     
     void sendReply(int fd, const std::string& reply);
+    void sendReply(int fd, ReplyBuilder& reply);
+    void sendMessage(int fd, SharedMessage* msg);
     void broadcastToChannel(const std::string& channel, const std::string& message, int exclude_fd = -1);
-    std::string formatServerReply(int fd, const std::string& numericAndParams) const;
+    void broadcastToChannel(const ChannelInfo& channel, const std::string& message, int exclude_fd = -1);
+    void broadcastToChannel(const ChannelInfo& channel, SharedMessage* msg, int exclude_fd = -1);
+    // Scratch arena of the calling event loop, for ReplyBuilder
+    BumpArena& scratch();
+    // Runs a first step of task right away; if it is not finished, fd's
+    // reactor keeps stepping it and holds back fd's input until it is.
+    // Takes ownership.
+    void startTask(int fd, Task* task);
+    // True when fd, owned by the calling reactor, has enough output queued
+    // that a task should pause
+    bool outputBacklogged(int fd);
+    bool outputBacklogged(const ClientInfo& client) const;
+    // RPL_NAMREPLY lines of at most MAX_MESSAGE_LENGTH bytes, then
+    // RPL_ENDOFNAMES. channel may be NULL, which sends only the end marker.
+    void sendNames(int fd, ChannelInfo* channel, const std::string& name);
+    // Sends a templated numeric to fd, addressed to its current nickname
+    void sendNumeric(int fd, NumericId id, const NumericArg& a = NumericArg(), const NumericArg& b = NumericArg(),
+                     const NumericArg& c = NumericArg(), const NumericArg& d = NumericArg(),
+                     const NumericArg& e = NumericArg());
     std::string formatUserMessage(int fd, const std::string& command) const;
+    // Raw slices of the line being dispatched, for handlers that want to
+    // avoid the std::string parameter copies
+    const MessageView& currentMessage() const;
     
     bool isChannelOperator(const std::string& channel, int fd);
     bool isClientInChannel(const std::string& channel, int fd);
     int getClientFdByNick(const std::string& nickname);
-    void removeClient(int fd);
+    void setNickname(int fd, const std::string& nickname);
+    void removeClient(int fd, DisconnectReason kind, const std::string& reason = "Client disconnected");
+    void markForDisconnect(int fd, const std::string& reason);
     
+    // Offline driving, for bench/microbench and traffic replay: one event
+    // loop on the calling thread, with no listener and no threads. Clients
+    // are attached on descriptors the caller opened (/dev/null will do);
+    // their replies stay queued until discardOutput drops them, so no
+    // socket is ever written. feedInput and dispatchLine return only once
+    // the tasks they start (LIST, WHO) have finished and the input held
+    // back meanwhile has been handled. Not for use together with run().
+    void setupOffline();
+    void attachClient(int fd);
+    // Drops fd as if its peer had closed the connection; closes fd
+    void detachClient(int fd);
+    // Handles n bytes as if just read from fd's socket. Returns false once
+    // the client is gone.
+    bool feedInput(int fd, const char* data, size_t n);
+    // Dispatches one line without its CR/LF; false when flood control held it
+    bool dispatchLine(int fd, const char* line, size_t len);
+    // Drops every queued reply instead of writing it; returns the bytes dropped
+    size_t discardOutput();
+
     static const std::string SERVER_NAME;
 
 private:
     int _port;
     std::string _password;
-    int _sockfd;
-    std::vector<struct pollfd> _fds;
-    std::map<int, ClientInfo> _clients;
-    std::map<std::string, ChannelInfo> _channels; // channel name -> channel info
+    ServerConfig _config;
+    std::vector<Reactor*> _reactors;              // One per event-loop thread
+    // Guards the shared state below. Every command, accept, removal and
+    // task step takes it, so threads only overlap in socket I/O and
+    // framing; command handling itself runs one reactor at a time. Waits
+    // for it are counted in ReactorMetrics::lockWaits and lockWaitNs.
+    pthread_mutex_t _stateLock;
+    unsigned long _nextClientId;
+    SymbolTable _symbols;                          // Interned nicknames and channel names
+    FdArena<ClientInfo> _clients;                  // fd -> client
+    ChannelTable _channels;                        // Channel ids, looked up by symbol
+    std::vector<int> _nickOwner;                   // Nickname SymbolId -> fd, -1 if free
+    NumericFormatter _numerics;                    // Reply heads built for SERVER_NAME
+    unsigned long _throttleEvents;                 // Flood-control counters, atomic
+    unsigned long _throttledClients;
+    long _startedNs;                               // Monotonic clock at startup, for uptime
+    MetricsEndpoint* _metricsEndpoint;             // Owned by reactor 0's loop, NULL when disabled
+    CaptureWriter* _capture;                       // NULL unless recording, see ServerConfig::capturePath
+    size_t _offlineDropped;                        // Reply bytes dropped since the last discardOutput
 
     void setup();
-    void handleNewConnection();
-    void handleClientData(int fd);
-    void processMessage(int fd, const std::string& message);
+    int createListener(int port, bool reusePort, bool loopbackOnly);
+    void runReactor(Reactor& reactor);
+    void handleNewConnection(Reactor& reactor);
+    void adoptClient(Reactor& reactor, int fd);
+    void settleOffline(Reactor& reactor);
+    void dropOutput(Reactor& reactor);
+    bool processInput(Reactor& reactor, int fd, const char* chunk, size_t n, size_t& quota);
+    void handleClientWrite(Reactor& reactor, int fd);
+    void queueOutput(Reactor& reactor, ClientInfo& client, SharedMessage* msg);
+    void deliverMail(Reactor& reactor);
+    void flushDirty(Reactor& reactor);
+    bool flushClient(ClientInfo& client);
+    void updateInterest(Reactor& reactor, ClientInfo& client);
+    void markClosing(Reactor& reactor, ClientInfo& client, DisconnectReason kind, const std::string& reason);
+    void postClose(ClientInfo& client, DisconnectReason kind, const std::string& reason);
+    void reapClients(Reactor& reactor);
+    const std::string& channelNames(ChannelInfo& channel);
+    void markReadable(Reactor& reactor, int fd);
+    void enqueueReady(Reactor& reactor, ClientInfo& client);
+    void runScheduled(Reactor& reactor);
+    bool serviceClient(Reactor& reactor, ClientInfo& client);
+    void runTasks(Reactor& reactor);
+    bool hasRunnableWork(Reactor& reactor);
+    bool processMessage(int fd, const char* line, size_t len);
+    bool admitCommand(ClientInfo& client, unsigned int cost);
+    void clientTimerExpired(ClientInfo& client, ClientTimer::Kind kind);
     
+    friend class ClientTimer;
+
     static void signalHandler(int signum);
+    static void* reactorThread(void* arg);
+
+    Server(const Server&);
+    Server& operator=(const Server&);
 };
 
 #endif // SERVER_HPP
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "SymbolTable.hpp"
+
+SymbolTable::SymbolTable() {}
+
+SymbolId SymbolTable::find(const char* name, size_t len) const {
+    int id = _index.find(name, len);
+    return id < 0 ? NO_SYMBOL : static_cast<SymbolId>(id);
+}
+
+SymbolId SymbolTable::intern(const std::string& name) {
+    SymbolId id = find(name);
+    if (id != NO_SYMBOL) {
+        ++_entries[id].refs;
+        return id;
+    }
+    if (!_free.empty()) {
+        id = _free.back();
+        _free.pop_back();
+    } else {
+        id = static_cast<SymbolId>(_entries.size());
+        _entries.push_back(Entry());
+    }
+    Entry& entry = _entries[id];
+    entry.text = name;
+    entry.hash = NameIndex::hashName(name.data(), name.length());
+    entry.refs = 1;
+    _index.insert(name, static_cast<int>(id));
+    return id;
+}
+
+void SymbolTable::release(SymbolId id) {
+    Entry& entry = _entries[id];
+    if (--entry.refs > 0) return;
+    _index.erase(entry.text);
+    entry.text.clear();
+    _free.push_back(id);
+}
@@ -0,0 +1,50 @@
+#ifndef SYMBOLTABLE_HPP
+#define SYMBOLTABLE_HPP
+
+#include <string>
+#include <vector>
+#include "NameIndex.hpp"
+
+typedef unsigned int SymbolId;
+static const SymbolId NO_SYMBOL = 0xffffffffu;
+
+// Interns IRC names (nicknames, channel names) as reference-counted 32-bit
+// ids. Names that are equal under RFC 1459 casemapping share one id, and
+// each symbol keeps its casefolded hash, so tables keyed by name can be
+// plain vectors indexed by SymbolId. Ids are reused once their last
+// reference is released.
+class SymbolTable {
+public:
+    SymbolTable();
+
+    SymbolId find(const char* name, size_t len) const;     // NO_SYMBOL when absent
+    SymbolId find(const std::string& name) const { return find(name.data(), name.length()); }
+    SymbolId intern(const std::string& name);               // Takes one reference
+    void retain(SymbolId id) { ++_entries[id].refs; }
+    void release(SymbolId id);
+
+    // Spelling the symbol was first interned with
+    const std::string& text(SymbolId id) const { return _entries[id].text; }
+    unsigned int hash(SymbolId id) const { return _entries[id].hash; }
+    size_t size() const { return _index.size(); }
+    // Upper bound on ids, for sizing tables indexed by SymbolId
+    SymbolId idLimit() const { return static_cast<SymbolId>(_entries.size()); }
+
+private:
+    struct Entry {
+        std::string text;
+        unsigned int hash;
+        unsigned int refs;
+
+        Entry() : hash(0), refs(0) {}
+    };
+
+    std::vector<Entry> _entries;
+    std::vector<SymbolId> _free;
+    NameIndex _index;               // casemapped name -> id
+
+    SymbolTable(const SymbolTable&);
+    SymbolTable& operator=(const SymbolTable&);
+};
+
+#endif // SYMBOLTABLE_HPP
@@ -0,0 +1,20 @@
+#ifndef TASK_HPP
+#define TASK_HPP
+
+class Server;
+
+// Continuation of a command too expensive to finish in one go (LIST over
+// every channel, WHO on a large channel). The owning reactor calls step()
+// between socket turns, under its time budget and only while the client's
+// output queue has room; until the task finishes the client's further
+// input waits, so replies keep their order.
+class Task {
+public:
+    virtual ~Task() {}
+
+    // Does a bounded slice of the work for fd, with the state lock held.
+    // Returns false once the task is finished.
+    virtual bool step(Server& server, int fd) = 0;
+};
+
+#endif // TASK_HPP
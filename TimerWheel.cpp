@@ -0,0 +1,160 @@
+#include "TimerWheel.hpp"
+
+Timer::~Timer() {
+    if (_wheel != NULL) {
+        _wheel->cancel(*this);
+    }
+}
+
+TimerWheel::TimerWheel() : _now(0), _count(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        _occupied[level] = 0;
+        for (unsigned long slot = 0; slot < SLOTS; ++slot) {
+            TimerLink& head = _slots[level][slot];
+            head.prev = &head;
+            head.next = &head;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // Disarm whatever is still scheduled so owners outliving the wheel
+    // do not try to unlink from it
+    for (int level = 0; level < LEVELS; ++level) {
+        for (unsigned long slot = 0; slot < SLOTS; ++slot) {
+            TimerLink& head = _slots[level][slot];
+            while (head.next != &head) {
+                unlink(*static_cast<Timer*>(head.next));
+            }
+        }
+    }
+}
+
+void TimerWheel::schedule(Timer& timer, long nowMs, long delayMs) {
+    if (timer._wheel != NULL) {
+        timer._wheel->cancel(timer);
+    }
+    if (_count == 0 && tickAt(nowMs) > _now) {
+        _now = tickAt(nowMs);
+    }
+    // The deadline's tick, rounded up so the timer never fires early; the
+    // earliest it can fire is the tick after the last one processed
+    timer._expiry = tickAt(nowMs + (delayMs > 0 ? delayMs : 0) + TICK_MS - 1);
+    if (timer._expiry <= _now) {
+        timer._expiry = _now + 1;
+    }
+    timer._wheel = this;
+    ++_count;
+    insert(timer);
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer._wheel == this) {
+        unlink(timer);
+    }
+}
+
+void TimerWheel::insert(Timer& timer) {
+    unsigned long delta = timer._expiry - _now;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (SLOTS << (SLOT_BITS * level))) {
+        ++level;
+    }
+    unsigned long limit = SLOTS << (SLOT_BITS * level);
+    if (delta >= limit) {
+        // Beyond the top wheel: park in its furthest slot; each cascade
+        // re-places it until the expiry is in range
+        delta = limit - 1;
+    }
+    unsigned long slot = ((_now + delta) >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TimerLink& head = _slots[level][slot];
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    _occupied[level] |= 1ULL << slot;
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    TimerLink* next = timer.next;
+    timer.prev->next = next;
+    next->prev = timer.prev;
+    if (next == timer.prev) {
+        // Only the slot head is left
+        unsigned long index = static_cast<unsigned long>(next - &_slots[0][0]);
+        _occupied[index / SLOTS] &= ~(1ULL << (index % SLOTS));
+    }
+    timer.prev = NULL;
+    timer.next = NULL;
+    timer._wheel = NULL;
+    --_count;
+}
+
+// Re-places the slot of level that the current tick has reached; its timers
+// move to lower levels, or to level 0's current slot when due now
+void TimerWheel::cascade(int level) {
+    unsigned long slot = (_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TimerLink& head = _slots[level][slot];
+    if (head.next == &head) {
+        return;
+    }
+    TimerLink* link = head.next;
+    head.prev->next = NULL;
+    head.prev = &head;
+    head.next = &head;
+    _occupied[level] &= ~(1ULL << slot);
+    while (link != NULL) {
+        TimerLink* next = link->next;
+        insert(*static_cast<Timer*>(link));
+        link = next;
+    }
+}
+
+void TimerWheel::advance(long nowMs, Server& server) {
+    unsigned long target = tickAt(nowMs);
+    while (_now < target && _count > 0) {
+        ++_now;
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((_now & ((1UL << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+        // Expire one timer at a time: a callback may cancel or re-arm any
+        // timer, including those still waiting in this slot
+        TimerLink& head = _slots[0][_now & (SLOTS - 1)];
+        while (head.next != &head) {
+            Timer& timer = *static_cast<Timer*>(head.next);
+            unlink(timer);
+            timer.expire(server);
+        }
+    }
+    if (_now < target) {
+        _now = target;
+    }
+}
+
+int TimerWheel::nextTimeout(long nowMs) const {
+    if (_count == 0) {
+        return -1;
+    }
+    // Upper levels only need a wake-up when level 0 wraps and cascades
+    unsigned long current = _now & (SLOTS - 1);
+    unsigned long ticks = SLOTS - current;
+    unsigned long long ahead = current + 1 < SLOTS ? _occupied[0] >> (current + 1) : 0;
+    bool upper = false;
+    for (int level = 1; level < LEVELS; ++level) {
+        upper = upper || _occupied[level] != 0;
+    }
+    if (ahead != 0) {
+        ticks = static_cast<unsigned long>(__builtin_ctzll(ahead)) + 1;
+    } else if (!upper) {
+        // Only slots behind the cursor: the nearest is reached after the wrap
+        ticks += static_cast<unsigned long>(__builtin_ctzll(_occupied[0]));
+    }
+    long wait = static_cast<long>(_now + ticks) * TICK_MS - nowMs;
+    if (wait < 0) {
+        return 0;
+    }
+    return wait > 0x7fffffffL ? 0x7fffffff : static_cast<int>(wait);
+}
@@ -0,0 +1,85 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <cstddef>
+
+class Server;
+class TimerWheel;
+
+// Intrusive list links; the wheel's slot heads are bare links
+struct TimerLink {
+    TimerLink* prev;
+    TimerLink* next;
+};
+
+// Something the wheel can expire. Timers are embedded in their owner (each
+// client carries its own) or allocated by the caller; the wheel only links
+// them in, so scheduling never allocates. Destroying an armed timer
+// cancels it.
+class Timer : private TimerLink {
+public:
+    Timer() : _wheel(NULL), _expiry(0) { prev = NULL; next = NULL; }
+    virtual ~Timer();
+
+    bool armed() const { return _wheel != NULL; }
+    // Runs on the owning reactor's thread with the state lock held; may
+    // schedule the timer again
+    virtual void expire(Server& server) = 0;
+
+private:
+    friend class TimerWheel;
+    TimerWheel* _wheel;
+    unsigned long _expiry;          // Absolute tick
+
+    Timer(const Timer&);
+    Timer& operator=(const Timer&);
+};
+
+// Hierarchical timing wheel: LEVELS wheels of 64 slots, slot width growing
+// 64x per level, so the wheels cover about 46 hours at 10 ms resolution;
+// later timers wait in the top level's last slot and are re-placed.
+// Times are CLOCK_MONOTONIC milliseconds; an empty wheel jumps straight to
+// the present, so long idle stretches cost nothing to catch up on.
+// Scheduling and cancelling are O(1) list operations; a timer moves down a
+// level at most LEVELS - 1 times before it fires. A 64-bit occupancy mask
+// per level lets nextTimeout() skip empty slots without scanning them.
+class TimerWheel {
+public:
+    static const long TICK_MS = 10;
+
+    TimerWheel();
+    ~TimerWheel();
+
+    // (Re)arms timer to expire delayMs from nowMs, rounded up to a tick
+    void schedule(Timer& timer, long nowMs, long delayMs);
+    void cancel(Timer& timer);
+
+    // True when advance() has ticks to process
+    bool due(long nowMs) const { return _count > 0 && tickAt(nowMs) > _now; }
+    // Expires every timer due by nowMs, in tick order
+    void advance(long nowMs, Server& server);
+    // Milliseconds until advance() may have work, -1 when nothing is armed
+    int nextTimeout(long nowMs) const;
+
+    size_t size() const { return _count; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const unsigned long SLOTS = 1UL << SLOT_BITS;
+
+    TimerLink _slots[LEVELS][SLOTS];
+    unsigned long long _occupied[LEVELS];
+    unsigned long _now;             // Last processed tick, monotonic ms / TICK_MS
+    size_t _count;
+
+    static unsigned long tickAt(long ms) { return static_cast<unsigned long>(ms / TICK_MS); }
+    void insert(Timer& timer);
+    void unlink(Timer& timer);
+    void cascade(int level);
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+};
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,720 @@
+// Load generator: opens simulated clients over loopback, registers them
+// with PASS/NICK/USER and drives one or more scenarios, then reports
+// throughput and delivery latency as JSON:
+//   fanout     clients spread over channels, PRIVMSG to the sender's channel
+//   pm         private messages between random pairs of clients
+//   churn      every client loops JOIN / PART, latency is until its own echo
+//   reconnect  all clients connect and register at once, latency is until 001
+//   slow       fanout with extra members that never read their socket
+// Messages carry their send time, so latency is measured per delivery.
+// `make bench` runs every scenario against a fresh server for each; run by
+// hand with
+//   ./bench/loadgen --server=./ircserv [--scenario=NAME] [--clients=N] ...
+// or against a server that is already running by leaving out --server.
+// A spawned server runs with --flood-rate=0 --log-level=error followed by
+// every --server-arg=OPTION, so e.g. --server-arg=--threads=4 compares
+// configurations and --server-arg=--flood-rate=10 turns flood control on.
+
+#include "../Metrics.hpp"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+struct Options {
+    std::string server;             // ircserv binary to spawn, empty to use a running one
+    std::vector<std::string> serverArgs;    // Options for the spawned server
+    int port;
+    std::string password;
+    std::string scenario;           // One name or "all"
+    std::string json;               // Output file, empty for stdout
+    std::string label;              // Free text recorded in the report, e.g. a commit
+    long clients;                   // 0 picks the scenario default
+    long channels;
+    long rate;                      // Messages per second across all senders
+    double duration;                // Seconds of sending
+    long slow;                      // Non-reading members in the slow scenario
+
+    Options() : port(16667), password("benchpw"), scenario("all"), clients(0), channels(0), rate(0),
+                duration(3.0), slow(0) {}
+};
+
+struct Conn {
+    int fd;
+    std::string nick;
+    bool connected;
+    bool registered;
+    bool reading;                   // Slow readers stop after setup
+    std::string in;
+    std::string out;
+    bool dirty;
+    long registerSentNs;
+    long registeredNs;
+    // Churn loop
+    std::string channel;
+    bool joined;
+    bool waiting;
+    long opSentNs;
+
+    Conn() : fd(-1), connected(false), registered(false), reading(true), dirty(false), registerSentNs(0),
+             registeredNs(0), joined(false), waiting(false), opSentNs(0) {}
+};
+
+// Results of one scenario
+struct Report {
+    std::string name;
+    long clients;
+    double seconds;
+    unsigned long sent;
+    unsigned long expected;
+    unsigned long delivered;
+    unsigned long failed;
+    Histogram latency;              // ns
+
+    Report() : clients(0), seconds(0), sent(0), expected(0), delivered(0), failed(0) {}
+};
+
+// Each client needs its own descriptor, so lift the soft limit as far as allowed
+static void raiseFileLimit(size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+    rlim_t target = static_cast<rlim_t>(wanted);
+    if (rl.rlim_max != RLIM_INFINITY && target > rl.rlim_max) target = rl.rlim_max;
+    if (rl.rlim_cur < target) {
+        rl.rlim_cur = target;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// Simulated clients multiplexed over one epoll instance. Output is
+// buffered and written once per loop turn; input is split into lines and
+// handed to the running scenario.
+class Load {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() {}
+        virtual void onLine(Conn& conn, const std::string& line, long now) = 0;
+    };
+
+    Load(const Options& options) : _options(options), _handler(NULL) {
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        std::memset(&_addr, 0, sizeof(_addr));
+        _addr.sin_family = AF_INET;
+        _addr.sin_port = htons(options.port);
+        _addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    ~Load() {
+        closeAll();
+        close(_epoll);
+    }
+
+    std::vector<Conn> conns;
+
+    void setHandler(Handler* handler) { _handler = handler; }
+
+    // Starts count non-blocking connects; registration is sent once each completes
+    void open(size_t count, const std::string& prefix, size_t slowFrom, int rcvbuf) {
+        conns.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            Conn& c = conns[i];
+            char nick[32];
+            std::snprintf(nick, sizeof(nick), "%s%lu", prefix.c_str(), static_cast<unsigned long>(i));
+            c.nick = nick;
+            c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (c.fd < 0) continue;
+            if (i >= slowFrom) {
+                setsockopt(c.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            }
+            int one = 1;
+            setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (connect(c.fd, reinterpret_cast<sockaddr*>(&_addr), sizeof(_addr)) < 0 && errno != EINPROGRESS) {
+                close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            epoll_event ev;
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.u64 = i;
+            epoll_ctl(_epoll, EPOLL_CTL_ADD, c.fd, &ev);
+        }
+    }
+
+    void closeAll() {
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (conns[i].fd >= 0) close(conns[i].fd);
+        }
+        conns.clear();
+        _dirty.clear();
+    }
+
+    void send(size_t index, const std::string& text) {
+        Conn& c = conns[index];
+        if (c.fd < 0) return;
+        c.out += text;
+        if (!c.dirty) {
+            c.dirty = true;
+            _dirty.push_back(index);
+        }
+    }
+
+    // Stops reading: the socket buffer fills up and the server sees a slow reader
+    void stopReading(size_t index) {
+        Conn& c = conns[index];
+        c.reading = false;
+        epoll_event ev;
+        ev.events = c.out.empty() ? 0u : static_cast<unsigned>(EPOLLOUT);
+        ev.data.u64 = index;
+        epoll_ctl(_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    // One loop turn: write what was queued, wait up to timeoutMs, handle events
+    void poll(int timeoutMs) {
+        flush();
+        epoll_event events[512];
+        int n = epoll_wait(_epoll, events, 512, timeoutMs);
+        long now = nowNs();
+        for (int k = 0; k < n; ++k) {
+            size_t index = static_cast<size_t>(events[k].data.u64);
+            if (index >= conns.size()) continue;
+            Conn& c = conns[index];
+            if (c.fd < 0) continue;
+            if (!c.connected && (events[k].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+                    drop(index);
+                    continue;
+                }
+                c.connected = true;
+                c.registerSentNs = now;
+                send(index, "PASS " + _options.password + "\r\nNICK " + c.nick + "\r\nUSER " + c.nick
+                            + " 0 * :load\r\n");
+                continue;
+            }
+            if ((events[k].events & EPOLLOUT) && !c.out.empty()) {
+                writeOut(index);
+            }
+            if ((events[k].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && c.reading) {
+                readIn(index, now);
+            }
+        }
+        flush();
+    }
+
+    size_t countRegistered() const {
+        size_t n = 0;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (conns[i].registered) ++n;
+        }
+        return n;
+    }
+
+    size_t countAlive() const {
+        size_t n = 0;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (conns[i].fd >= 0) ++n;
+        }
+        return n;
+    }
+
+private:
+    const Options& _options;
+    Handler* _handler;
+    int _epoll;
+    sockaddr_in _addr;
+    std::vector<size_t> _dirty;
+
+    void drop(size_t index) {
+        Conn& c = conns[index];
+        if (c.fd < 0) return;
+        close(c.fd);
+        c.fd = -1;
+    }
+
+    void flush() {
+        std::vector<size_t> batch;
+        batch.swap(_dirty);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            conns[batch[i]].dirty = false;
+            if (conns[batch[i]].connected) writeOut(batch[i]);
+        }
+    }
+
+    void writeOut(size_t index) {
+        Conn& c = conns[index];
+        while (!c.out.empty() && c.fd >= 0) {
+            ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) drop(index);
+                break;
+            }
+            c.out.erase(0, static_cast<size_t>(n));
+        }
+        if (c.fd < 0) return;
+        epoll_event ev;
+        ev.events = (c.reading ? static_cast<unsigned>(EPOLLIN) : 0u) | (c.out.empty() ? 0u : static_cast<unsigned>(EPOLLOUT));
+        ev.data.u64 = index;
+        epoll_ctl(_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    void readIn(size_t index, long now) {
+        Conn& c = conns[index];
+        char buf[65536];
+        while (c.fd >= 0) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                drop(index);
+                return;
+            }
+            c.in.append(buf, static_cast<size_t>(n));
+        }
+        size_t start = 0;
+        size_t end;
+        while ((end = c.in.find('\n', start)) != std::string::npos) {
+            std::string line = c.in.substr(start, end > start && c.in[end - 1] == '\r' ? end - start - 1 : end - start);
+            start = end + 1;
+            handleLine(index, line, now);
+        }
+        c.in.erase(0, start);
+    }
+
+    void handleLine(size_t index, const std::string& line, long now) {
+        Conn& c = conns[index];
+        if (line.compare(0, 5, "PING ") == 0) {
+            send(index, "PONG " + line.substr(5) + "\r\n");
+            return;
+        }
+        if (!c.registered && line.find(" 001 ") != std::string::npos) {
+            c.registered = true;
+            c.registeredNs = now;
+        }
+        if (_handler != NULL) _handler->onLine(c, line, now);
+    }
+
+    Load(const Load&);
+    Load& operator=(const Load&);
+};
+
+// "... PRIVMSG <target> :T<ns>": the embedded send time, or -1
+static long sentTime(const std::string& line) {
+    size_t at = line.find(" :T");
+    if (at == std::string::npos || line.find(" PRIVMSG ") == std::string::npos) return -1;
+    return std::strtol(line.c_str() + at + 3, NULL, 10);
+}
+
+// Counts and times every timestamped PRIVMSG that arrives
+class DeliveryHandler : public Load::Handler {
+public:
+    explicit DeliveryHandler(Report& report) : _report(report) {}
+
+    virtual void onLine(Conn& conn, const std::string& line, long now) {
+        (void)conn;
+        long sent = sentTime(line);
+        if (sent < 0) return;
+        ++_report.delivered;
+        _report.latency.record(static_cast<unsigned long>(now - sent));
+        lastDelivery = now;
+    }
+
+    long lastDelivery;
+
+private:
+    Report& _report;
+};
+
+// Connects and registers count clients; returns false unless all made it
+static bool connectAll(Load& load, size_t count, const std::string& prefix, size_t slowFrom, double timeout) {
+    load.open(count, prefix, slowFrom, 4096);
+    long deadline = nowNs() + static_cast<long>(timeout * 1e9);
+    while (load.countRegistered() < count && nowNs() < deadline) {
+        load.poll(10);
+    }
+    return load.countRegistered() == count;
+}
+
+// Joins client i to channel names[i % names.size()], waiting for all echoes
+class JoinHandler : public Load::Handler {
+public:
+    JoinHandler() : joined(0) {}
+    virtual void onLine(Conn& conn, const std::string& line, long now) {
+        (void)now;
+        if (!conn.joined && line.compare(0, conn.nick.size() + 2, ":" + conn.nick + "!") == 0
+            && line.find(" JOIN ") != std::string::npos) {
+            conn.joined = true;
+            ++joined;
+        }
+    }
+    size_t joined;
+};
+
+static bool joinAll(Load& load, const std::vector<std::string>& channels, size_t count) {
+    JoinHandler handler;
+    load.setHandler(&handler);
+    for (size_t i = 0; i < count; ++i) {
+        load.conns[i].channel = channels[i % channels.size()];
+        load.send(i, "JOIN " + load.conns[i].channel + "\r\n");
+    }
+    long deadline = nowNs() + 30000000000L;
+    while (handler.joined < count && nowNs() < deadline) {
+        load.poll(10);
+    }
+    load.setHandler(NULL);
+    return handler.joined == count;
+}
+
+static std::string timestamped(const std::string& target, long now) {
+    char text[96];
+    std::snprintf(text, sizeof(text), "PRIVMSG %s :T%ld\r\n", target.c_str(), now);
+    return text;
+}
+
+// Open-loop sending: the message count due by now follows the target rate,
+// whatever the server's pace, so queueing shows up as latency. Then waits
+// up to two seconds for stragglers.
+template <typename Pick>
+static void drive(Load& load, Report& report, const Options& options, long rate, Pick pick,
+                  unsigned long deliveriesPerMessage) {
+    DeliveryHandler handler(report);
+    load.setHandler(&handler);
+    long start = nowNs();
+    long stop = start + static_cast<long>(options.duration * 1e9);
+    handler.lastDelivery = start;
+    unsigned long seq = 0;
+    long now;
+    while ((now = nowNs()) < stop) {
+        unsigned long due = static_cast<unsigned long>(static_cast<double>(now - start) / 1e9 * rate);
+        while (report.sent < due) {
+            pick(load, seq++, now);
+            ++report.sent;
+        }
+        load.poll(1);
+    }
+    report.expected = report.sent * deliveriesPerMessage;
+    long drainUntil = nowNs() + 2000000000L;
+    while (report.delivered < report.expected && nowNs() < drainUntil) {
+        load.poll(10);
+    }
+    report.seconds = static_cast<double>(handler.lastDelivery - start) / 1e9;
+    load.setHandler(NULL);
+}
+
+// Sender picks for the message-driven scenarios
+struct ChannelPick {
+    size_t senders;
+    void operator()(Load& load, unsigned long seq, long now) const {
+        size_t i = seq % senders;
+        load.send(i, timestamped(load.conns[i].channel, now));
+    }
+};
+
+struct PrivatePick {
+    size_t clients;
+    void operator()(Load& load, unsigned long seq, long now) const {
+        size_t from = seq % clients;
+        size_t to = (from + 1 + (seq * 2654435761UL) % (clients - 1)) % clients;
+        load.send(from, timestamped(load.conns[to].nick, now));
+    }
+};
+
+static std::vector<std::string> channelNames(const std::string& prefix, size_t count) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "#%s%lu", prefix.c_str(), static_cast<unsigned long>(i));
+        names.push_back(name);
+    }
+    return names;
+}
+
+static long pick(long value, long fallback) {
+    return value > 0 ? value : fallback;
+}
+
+static bool runFanout(const Options& options, Report& report, bool slowReaders) {
+    size_t clients = static_cast<size_t>(pick(options.clients, 200));
+    size_t channels = static_cast<size_t>(pick(options.channels, 4));
+    size_t slow = slowReaders ? static_cast<size_t>(pick(options.slow, 10)) : 0;
+    long rate = pick(options.rate, 1000);
+    if (clients < 2 * channels) channels = clients / 2 > 0 ? clients / 2 : 1;
+    report.clients = static_cast<long>(clients + slow);
+    Load load(options);
+    if (!connectAll(load, clients + slow, slowReaders ? "s" : "f", clients, 30.0)) return false;
+    // Readers are spread round-robin, slow ones included
+    if (!joinAll(load, channelNames(slowReaders ? "slow" : "fan", channels), clients + slow)) return false;
+    for (size_t i = clients; i < clients + slow; ++i) {
+        load.stopReading(i);
+    }
+    ChannelPick senders;
+    senders.senders = clients;
+    // Every channel has clients / channels reading members, minus the sender
+    drive(load, report, options, rate, senders, clients / channels - 1);
+    report.failed = clients + slow - load.countAlive();
+    return true;
+}
+
+static bool runPrivate(const Options& options, Report& report) {
+    size_t clients = static_cast<size_t>(pick(options.clients, 1000));
+    if (clients < 2) clients = 2;
+    report.clients = static_cast<long>(clients);
+    Load load(options);
+    if (!connectAll(load, clients, "p", clients, 30.0)) return false;
+    PrivatePick senders;
+    senders.clients = clients;
+    drive(load, report, options, pick(options.rate, 20000), senders, 1);
+    report.failed = clients - load.countAlive();
+    return true;
+}
+
+// Closed loop: each client sends JOIN, waits for its own JOIN echo, sends
+// PART, waits for that echo, and so on. Latency is per operation.
+class ChurnHandler : public Load::Handler {
+public:
+    explicit ChurnHandler(Report& report) : _report(report) {}
+
+    virtual void onLine(Conn& conn, const std::string& line, long now) {
+        if (!conn.waiting || line.compare(0, conn.nick.size() + 2, ":" + conn.nick + "!") != 0) return;
+        bool join = line.find(" JOIN ") != std::string::npos;
+        bool part = line.find(" PART ") != std::string::npos;
+        if (!join && !part) return;
+        conn.joined = join;
+        conn.waiting = false;
+        ++_report.delivered;
+        _report.latency.record(static_cast<unsigned long>(now - conn.opSentNs));
+    }
+
+private:
+    Report& _report;
+};
+
+static bool runChurn(const Options& options, Report& report) {
+    size_t clients = static_cast<size_t>(pick(options.clients, 200));
+    std::vector<std::string> channels = channelNames("churn", static_cast<size_t>(pick(options.channels, 16)));
+    report.clients = static_cast<long>(clients);
+    Load load(options);
+    if (!connectAll(load, clients, "c", clients, 30.0)) return false;
+    ChurnHandler handler(report);
+    load.setHandler(&handler);
+    long start = nowNs();
+    long stop = start + static_cast<long>(options.duration * 1e9);
+    long now;
+    while ((now = nowNs()) < stop) {
+        for (size_t i = 0; i < clients; ++i) {
+            Conn& c = load.conns[i];
+            if (c.waiting || c.fd < 0) continue;
+            if (!c.joined) c.channel = channels[(i + report.sent) % channels.size()];
+            load.send(i, (c.joined ? "PART " : "JOIN ") + c.channel + "\r\n");
+            c.waiting = true;
+            c.opSentNs = now;
+            ++report.sent;
+        }
+        load.poll(1);
+    }
+    long drainUntil = nowNs() + 2000000000L;
+    while (report.delivered < report.sent && nowNs() < drainUntil) {
+        load.poll(10);
+    }
+    report.expected = report.sent;
+    report.seconds = static_cast<double>(nowNs() - start) / 1e9;
+    report.failed = clients - load.countAlive();
+    return true;
+}
+
+// Every client connects at once; latency runs from the connect call to 001
+static bool runReconnect(const Options& options, Report& report) {
+    size_t clients = static_cast<size_t>(pick(options.clients, 5000));
+    raiseFileLimit(clients + 64);
+    report.clients = static_cast<long>(clients);
+    Load load(options);
+    long start = nowNs();
+    connectAll(load, clients, "r", clients, 60.0);
+    long end = start;
+    for (size_t i = 0; i < clients; ++i) {
+        const Conn& c = load.conns[i];
+        if (!c.registered) continue;
+        report.latency.record(static_cast<unsigned long>(c.registeredNs - start));
+        if (c.registeredNs > end) end = c.registeredNs;
+    }
+    report.sent = clients;
+    report.expected = clients;
+    report.delivered = load.countRegistered();
+    report.failed = clients - report.delivered;
+    report.seconds = static_cast<double>(end - start) / 1e9;
+    return true;
+}
+
+// Starts the server binary on options.port and waits until it accepts
+static pid_t spawnServer(const Options& options) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null = ::open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        char port[16];
+        std::snprintf(port, sizeof(port), "%d", options.port);
+        std::vector<const char*> argv;
+        argv.push_back(options.server.c_str());
+        argv.push_back(port);
+        argv.push_back(options.password.c_str());
+        argv.push_back("--flood-rate=0");
+        argv.push_back("--log-level=error");
+        for (size_t i = 0; i < options.serverArgs.size(); ++i) argv.push_back(options.serverArgs[i].c_str());
+        argv.push_back(NULL);
+        execv(options.server.c_str(), const_cast<char* const*>(&argv[0]));
+        _exit(127);
+    }
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bool up = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(fd);
+        if (up) return pid;
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void stopServer(pid_t pid) {
+    if (pid <= 0) return;
+    kill(pid, SIGINT);
+    waitpid(pid, NULL, 0);
+}
+
+static void writeReport(FILE* out, const Report& r, bool last) {
+    double us = 1000.0;
+    double rate = r.seconds > 0 ? static_cast<double>(r.delivered) / r.seconds : 0.0;
+    std::fprintf(out,
+                 "    {\"name\": \"%s\", \"clients\": %ld, \"seconds\": %.3f, \"sent\": %lu, \"expected\": %lu, "
+                 "\"delivered\": %lu, \"failed_clients\": %lu, \"msgs_per_sec\": %.1f, "
+                 "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}%s\n",
+                 r.name.c_str(), r.clients, r.seconds, r.sent, r.expected, r.delivered, r.failed, rate,
+                 r.latency.quantile(0.5) / us, r.latency.quantile(0.99) / us, r.latency.quantile(0.999) / us,
+                 r.latency.max() / us, last ? "" : ",");
+}
+
+static bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (name == "server") options.server = value;
+        else if (name == "server-arg") options.serverArgs.push_back(value);
+        else if (name == "port") options.port = std::atoi(value.c_str());
+        else if (name == "password") options.password = value;
+        else if (name == "scenario") options.scenario = value;
+        else if (name == "json") options.json = value;
+        else if (name == "label") options.label = value;
+        else if (name == "clients") options.clients = std::atol(value.c_str());
+        else if (name == "channels") options.channels = std::atol(value.c_str());
+        else if (name == "rate") options.rate = std::atol(value.c_str());
+        else if (name == "duration") options.duration = std::atof(value.c_str());
+        else if (name == "slow") options.slow = std::atol(value.c_str());
+        else return false;
+    }
+    return options.port > 0 && options.duration > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--server=PATH] [--server-arg=OPTION]... [--port=N] [--password=PW] [--scenario=all|fanout|pm|churn|"
+                             "reconnect|slow]\n          [--clients=N] [--channels=N] [--rate=MSGS] "
+                             "[--duration=SECONDS] [--slow=N] [--json=FILE] [--label=TEXT]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raiseFileLimit(static_cast<size_t>(pick(options.clients, 5000)) + 256);
+
+    const char* all[] = { "fanout", "pm", "churn", "reconnect", "slow" };
+    std::vector<std::string> names;
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i) {
+        if (options.scenario == "all" || options.scenario == all[i]) names.push_back(all[i]);
+    }
+    if (names.empty()) {
+        std::fprintf(stderr, "Unknown scenario %s\n", options.scenario.c_str());
+        return 1;
+    }
+
+    std::vector<Report> reports;
+    bool ok = true;
+    for (size_t i = 0; i < names.size(); ++i) {
+        pid_t server = -1;
+        if (!options.server.empty() && (server = spawnServer(options)) < 0) {
+            std::fprintf(stderr, "Could not start %s on port %d\n", options.server.c_str(), options.port);
+            return 1;
+        }
+        Report report;
+        report.name = names[i];
+        bool ran;
+        if (names[i] == "fanout") ran = runFanout(options, report, false);
+        else if (names[i] == "pm") ran = runPrivate(options, report);
+        else if (names[i] == "churn") ran = runChurn(options, report);
+        else if (names[i] == "reconnect") ran = runReconnect(options, report);
+        else ran = runFanout(options, report, true);
+        stopServer(server);
+        if (!ran) {
+            std::fprintf(stderr, "%s: setup failed (clients did not all register or join)\n", names[i].c_str());
+            ok = false;
+            continue;
+        }
+        std::fprintf(stderr, "%-10s %8.0f msgs/s  p50 %8.1f us  p99 %8.1f us  p999 %8.1f us\n", names[i].c_str(),
+                     report.seconds > 0 ? report.delivered / report.seconds : 0.0,
+                     report.latency.quantile(0.5) / 1000.0, report.latency.quantile(0.99) / 1000.0,
+                     report.latency.quantile(0.999) / 1000.0);
+        reports.push_back(report);
+    }
+
+    FILE* out = options.json.empty() ? stdout : std::fopen(options.json.c_str(), "w");
+    if (out == NULL) {
+        std::fprintf(stderr, "Cannot write %s\n", options.json.c_str());
+        return 1;
+    }
+    std::string serverArgs;
+    for (size_t i = 0; i < options.serverArgs.size(); ++i) {
+        if (i > 0) serverArgs += ' ';
+        serverArgs += options.serverArgs[i];
+    }
+    std::fprintf(out, "{\n  \"label\": \"%s\",\n  \"server_args\": \"%s\",\n  \"unix_time\": %ld,\n"
+                      "  \"duration_s\": %.1f,\n  \"scenarios\": [\n",
+                 options.label.c_str(), serverArgs.c_str(), static_cast<long>(time(NULL)), options.duration);
+    for (size_t i = 0; i < reports.size(); ++i) {
+        writeReport(out, reports[i], i + 1 == reports.size());
+    }
+    std::fprintf(out, "  ]\n}\n");
+    if (out != stdout) std::fclose(out);
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,435 @@
+// Hot-path microbenchmarks: parsing, line scanning, reply formatting, full
+// command dispatch through Server::processMessage and nickname lookup among
+// 256 to 65536 clients, in-process and without sockets
+// (Server::setupOffline; replies go to a sink that drops them). Reports
+// ns/op and heap allocations per op.
+//   ./bench/microbench [--filter=TEXT]            print the table
+//   ./bench/microbench --save=FILE                also store it as a baseline
+//   ./bench/microbench --compare=FILE [--threshold=PCT]
+// --compare exits 1 when an op got more than PCT percent slower (default
+// 5) or allocates more than in the baseline. Benchmarks with an allocation
+// budget (channel PRIVMSG must not allocate once warm) fail in every mode.
+// `make microbench_baseline` and `make microbench_check` wrap the last two.
+
+#include "../Server.hpp"
+#include "../parcer.hpp"
+#include "../LineScanner.hpp"
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Every heap allocation in the process goes through here. Kept out of
+// line, so the compiler does not pair a visible malloc with free at call
+// sites and warn about mismatched new and delete.
+static unsigned long g_allocs = 0;
+
+__attribute__((noinline)) void* operator new(std::size_t n) throw(std::bad_alloc) {
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    void* p = std::malloc(n != 0 ? n : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void* operator new[](std::size_t n) throw(std::bad_alloc) {
+    return operator new(n);
+}
+
+__attribute__((noinline)) void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) throw() {
+    std::free(p);
+}
+
+static unsigned long allocCount() {
+    return __atomic_load_n(&g_allocs, __ATOMIC_RELAXED);
+}
+
+static long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static volatile size_t g_sink;
+
+// Shared fixture: an offline server with registered clients, the first
+// CHANNEL_MEMBERS of them in #bench
+static const size_t CLIENTS = 256;
+static const size_t CHANNEL_MEMBERS = 10;
+static Server* g_server = NULL;
+static std::vector<int> g_fds;
+
+static void setupServer() {
+    ServerConfig config;
+    config.floodRate = 0;
+    g_server = new Server(0, "pw", config);
+    g_server->setupOffline();
+    for (size_t i = 0; i < CLIENTS; ++i) {
+        int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            std::perror("/dev/null");
+            std::exit(1);
+        }
+        g_server->attachClient(fd);
+        char text[128];
+        int n = std::snprintf(text, sizeof(text), "PASS pw\r\nNICK Nick%lu\r\nUSER u%lu 0 * :Bench User\r\n%s",
+                              static_cast<unsigned long>(i), static_cast<unsigned long>(i),
+                              i < CHANNEL_MEMBERS ? "JOIN #bench\r\n" : "");
+        g_server->feedInput(fd, text, static_cast<size_t>(n));
+        g_fds.push_back(fd);
+    }
+    g_server->discardOutput();
+}
+
+static void benchParseMessage(size_t n) {
+    const std::string line = ":Nick1!u1@host PRIVMSG #bench :hello there, this is a benchmark line";
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += parseMessage(line).size();
+    }
+}
+
+static void benchParseMessageView(size_t n) {
+    const char line[] = ":Nick1!u1@host PRIVMSG #bench :hello there, this is a benchmark line";
+    MessageView view;
+    for (size_t i = 0; i < n; ++i) {
+        parseMessageView(line, sizeof(line) - 1, view);
+        g_sink += view.paramCount;
+    }
+}
+
+static void benchSplitByComma(size_t n) {
+    const std::string list = "#one,#two,#three,#four";
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += splitByComma(list).size();
+    }
+}
+
+static void benchIsValidNickname(size_t n) {
+    const std::string nick = "Guest_12345";
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += isValidNickname(nick);
+    }
+}
+
+static void benchFindCommand(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += findCommand("privmsg", 7) != NULL;
+    }
+}
+
+// Lookups run against growing populations, so they come last in the table.
+// Clients beyond the fixture only register, and never do I/O, so they are
+// attached on descriptor numbers from RLIMIT_NOFILE up, which no open()
+// in this process can return, instead of on opened files.
+static size_t g_population = CLIENTS;
+static int g_nextIdleFd = -1;
+
+static void growPopulation(size_t count) {
+    if (g_nextIdleFd < 0) {
+        struct rlimit rl;
+        rlim_t limit = getrlimit(RLIMIT_NOFILE, &rl) == 0 ? rl.rlim_cur : 1024;
+        g_nextIdleFd = static_cast<int>(limit < (1U << 20) ? limit : (1U << 20));
+    }
+    for (; g_population < count; ++g_population) {
+        int fd = g_nextIdleFd++;
+        g_server->attachClient(fd);
+        char text[128];
+        int n = std::snprintf(text, sizeof(text), "PASS pw\r\nNICK Nick%lu\r\nUSER u%lu 0 * :Bench User\r\n",
+                              static_cast<unsigned long>(g_population), static_cast<unsigned long>(g_population));
+        g_server->feedInput(fd, text, static_cast<size_t>(n));
+        g_server->discardOutput();
+    }
+}
+
+// Case-insensitive hits spread over every registered nickname, cycling
+// through LOOKUP_KEYS of them so the table does not sit in cache the way a
+// single key would
+static const size_t LOOKUP_KEYS = 64;
+
+static void nickLookup(size_t population, size_t n) {
+    static std::map<size_t, std::vector<std::string> > keys;
+    growPopulation(population);
+    std::vector<std::string>& nicks = keys[population];
+    if (nicks.empty()) {
+        for (size_t k = 0; k < LOOKUP_KEYS; ++k) {
+            char nick[32];
+            unsigned long index = (k * population / LOOKUP_KEYS + 37) % population;
+            std::snprintf(nick, sizeof(nick), "NICK%lu", index);
+            if (g_server->getClientFdByNick(nick) < 0) {
+                std::fprintf(stderr, "%s did not register\n", nick);
+                std::exit(1);
+            }
+            nicks.push_back(nick);
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += static_cast<size_t>(g_server->getClientFdByNick(nicks[i % LOOKUP_KEYS]));
+    }
+}
+
+static void benchNickLookup256(size_t n) {
+    nickLookup(256, n);
+}
+
+static void benchNickLookup4096(size_t n) {
+    nickLookup(4096, n);
+}
+
+static void benchNickLookup65536(size_t n) {
+    nickLookup(65536, n);
+}
+
+// Per line of a 64 KB block of IRC traffic
+static std::string g_scanInput;
+
+static void setupScanInput() {
+    srand(42);
+    while (g_scanInput.size() < 64 * 1024) {
+        g_scanInput += "PRIVMSG #bench :";
+        size_t body = 20 + rand() % 380;
+        for (size_t i = 0; i < body; ++i) {
+            g_scanInput += static_cast<char>('a' + rand() % 26);
+        }
+        g_scanInput += "\r\n";
+    }
+}
+
+static void benchScanLine(size_t n) {
+    const char* data = g_scanInput.data();
+    size_t avail = g_scanInput.size();
+    size_t pos = avail;
+    for (size_t i = 0; i < n; ++i) {
+        if (pos >= avail) pos = 0;
+        bool hasNul;
+        size_t len = scanLine(data + pos, avail - pos, hasNul);
+        g_sink += len + hasNul;
+        pos += len + 1;
+    }
+}
+
+static void benchSendNumeric(size_t n) {
+    int fd = g_fds[0];
+    for (size_t i = 0; i < n; ++i) {
+        g_server->sendNumeric(fd, RPL_TOPIC, "#bench", "the topic of the benchmark channel");
+        g_server->discardOutput();
+    }
+}
+
+static void benchFormatUserMessage(size_t n) {
+    int fd = g_fds[0];
+    for (size_t i = 0; i < n; ++i) {
+        g_sink += g_server->formatUserMessage(fd, "PRIVMSG #bench :hello").size();
+    }
+}
+
+static void dispatch(int fd, const char* line, size_t n) {
+    size_t len = std::strlen(line);
+    for (size_t i = 0; i < n; ++i) {
+        g_server->dispatchLine(fd, line, len);
+        g_server->discardOutput();
+    }
+}
+
+static void benchPrivmsgChannel(size_t n) {
+    dispatch(g_fds[0], "PRIVMSG #bench :hello there, this is a benchmark line", n);
+}
+
+static void benchPrivmsgUser(size_t n) {
+    dispatch(g_fds[0], "PRIVMSG Nick200 :hello there, this is a benchmark line", n);
+}
+
+static void benchPing(size_t n) {
+    dispatch(g_fds[0], "PING :token", n);
+}
+
+static void benchJoinPart(size_t n) {
+    int fd = g_fds[CHANNEL_MEMBERS];
+    for (size_t i = 0; i < n; ++i) {
+        static const char join[] = "JOIN #churn";
+        static const char part[] = "PART #churn";
+        g_server->dispatchLine(fd, join, sizeof(join) - 1);
+        g_server->dispatchLine(fd, part, sizeof(part) - 1);
+        g_server->discardOutput();
+    }
+}
+
+// Framing plus dispatch of a 16-line read, per line
+static void benchFeedInput(size_t n) {
+    static std::string chunk;
+    if (chunk.empty()) {
+        for (int i = 0; i < 16; ++i) {
+            chunk += "PRIVMSG #bench :hello there, this is a benchmark line\r\n";
+        }
+    }
+    for (size_t i = 0; i < n; i += 16) {
+        g_server->feedInput(g_fds[0], chunk.data(), chunk.size());
+        g_server->discardOutput();
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)(size_t iterations);
+    double maxAllocs;               // Allocations per op allowed, negative for no limit
+};
+
+static const Benchmark BENCHMARKS[] = {
+    { "parse/parseMessage",         benchParseMessage,      -1 },
+    { "parse/parseMessageView",     benchParseMessageView,  0 },
+    { "parse/splitByComma",         benchSplitByComma,      -1 },
+    { "parse/isValidNickname",      benchIsValidNickname,   0 },
+    { "parse/findCommand",          benchFindCommand,       0 },
+    { "scan/scanLine",              benchScanLine,          0 },
+    { "format/sendNumeric",         benchSendNumeric,       -1 },
+    { "format/formatUserMessage",   benchFormatUserMessage, -1 },
+    { "dispatch/privmsg_channel",   benchPrivmsgChannel,    0 },
+    { "dispatch/privmsg_user",      benchPrivmsgUser,       0 },
+    { "dispatch/ping",              benchPing,              0 },
+    { "dispatch/join_part",         benchJoinPart,          -1 },
+    { "input/feed_16_lines",        benchFeedInput,         0 },
+    { "lookup/nickname_256",        benchNickLookup256,     0 },
+    { "lookup/nickname_4096",       benchNickLookup4096,    0 },
+    { "lookup/nickname_65536",      benchNickLookup65536,   0 },
+};
+
+struct Result {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+// Grows the iteration count until one sample takes SAMPLE_NS, which also
+// warms caches and pools, then keeps the fastest of SAMPLES samples: the
+// minimum is the figure least disturbed by the rest of the machine
+static const long SAMPLE_NS = 50000000;
+static const int SAMPLES = 5;
+
+static Result measure(const Benchmark& bench) {
+    size_t iterations = 16;
+    while (true) {
+        long start = nowNs();
+        bench.run(iterations);
+        long elapsed = nowNs() - start;
+        if (elapsed >= SAMPLE_NS / 4) {
+            iterations = static_cast<size_t>(static_cast<double>(iterations) * SAMPLE_NS / elapsed) + 1;
+            break;
+        }
+        iterations *= 2;
+    }
+    Result result;
+    result.nsPerOp = 0;
+    unsigned long allocs = allocCount();
+    for (int s = 0; s < SAMPLES; ++s) {
+        long start = nowNs();
+        bench.run(iterations);
+        double ns = static_cast<double>(nowNs() - start) / static_cast<double>(iterations);
+        if (s == 0 || ns < result.nsPerOp) result.nsPerOp = ns;
+    }
+    result.allocsPerOp = static_cast<double>(allocCount() - allocs) / (static_cast<double>(iterations) * SAMPLES);
+    return result;
+}
+
+// Baseline file: "name ns_per_op allocs_per_op" per line, '#' comments
+static bool loadBaseline(const std::string& path, std::map<std::string, Result>& out) {
+    FILE* in = std::fopen(path.c_str(), "r");
+    if (in == NULL) return false;
+    char line[256];
+    while (std::fgets(line, sizeof(line), in) != NULL) {
+        char name[128];
+        Result r;
+        if (line[0] == '#' || std::sscanf(line, "%127s %lf %lf", name, &r.nsPerOp, &r.allocsPerOp) != 3) continue;
+        out[name] = r;
+    }
+    std::fclose(in);
+    return true;
+}
+
+static bool saveBaseline(const std::string& path, const std::vector<std::string>& names,
+                         const std::vector<Result>& results) {
+    FILE* out = std::fopen(path.c_str(), "w");
+    if (out == NULL) return false;
+    std::fprintf(out, "# name ns_per_op allocs_per_op\n");
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::fprintf(out, "%s %.2f %.3f\n", names[i].c_str(), results[i].nsPerOp, results[i].allocsPerOp);
+    }
+    std::fclose(out);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string filter, save, compare;
+    double threshold = 5.0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--filter=") == 0) filter = arg.substr(9);
+        else if (arg.compare(0, 7, "--save=") == 0) save = arg.substr(7);
+        else if (arg.compare(0, 10, "--compare=") == 0) compare = arg.substr(10);
+        else if (arg.compare(0, 12, "--threshold=") == 0) threshold = std::atof(arg.c_str() + 12);
+        else {
+            std::fprintf(stderr, "Usage: %s [--filter=TEXT] [--save=FILE] [--compare=FILE] [--threshold=PCT]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+    std::map<std::string, Result> baseline;
+    if (!compare.empty() && !loadBaseline(compare, baseline)) {
+        std::fprintf(stderr, "Cannot read baseline %s\n", compare.c_str());
+        return 1;
+    }
+
+    Logger::start(LOG_LEVEL_ERROR);
+    setupServer();
+    setupScanInput();
+
+    std::vector<std::string> names;
+    std::vector<Result> results;
+    bool failed = false;
+    std::printf("%-28s %10s %10s", "benchmark", "ns/op", "allocs/op");
+    if (!compare.empty()) std::printf(" %10s %8s", "base ns", "change");
+    std::printf("\n");
+    for (size_t b = 0; b < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); ++b) {
+        const Benchmark& bench = BENCHMARKS[b];
+        if (!filter.empty() && std::string(bench.name).find(filter) == std::string::npos) continue;
+        Result r = measure(bench);
+        names.push_back(bench.name);
+        results.push_back(r);
+        std::printf("%-28s %10.1f %10.2f", bench.name, r.nsPerOp, r.allocsPerOp);
+
+        std::string verdict;
+        if (bench.maxAllocs >= 0 && r.allocsPerOp > bench.maxAllocs) {
+            verdict = "  ALLOCATES";
+        }
+        std::map<std::string, Result>::const_iterator base = baseline.find(bench.name);
+        if (!compare.empty() && base == baseline.end()) {
+            std::printf(" %10s %8s", "-", "new");
+        } else if (!compare.empty()) {
+            double change = (r.nsPerOp / base->second.nsPerOp - 1.0) * 100.0;
+            std::printf(" %10.1f %+7.1f%%", base->second.nsPerOp, change);
+            if (change > threshold) verdict += "  SLOWER";
+            // Counts are averages over many ops, so allow for rounding
+            if (r.allocsPerOp > base->second.allocsPerOp + 0.01) verdict += "  MORE ALLOCS";
+        }
+        std::printf("%s\n", verdict.c_str());
+        if (!verdict.empty()) failed = true;
+    }
+
+    delete g_server;
+    Logger::stop();
+    if (!save.empty() && !saveBaseline(save, names, results)) {
+        std::fprintf(stderr, "Cannot write baseline %s\n", save.c_str());
+        return 1;
+    }
+    if (failed) {
+        std::printf("FAILED: regressions beyond %.1f%% or over an allocation budget\n", threshold);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Reconnect storm: opens N connections to a running server at once, the way
+// clients come back after a netsplit or restart, and measures how long it
+// takes until every one of them is connected and registered (001 received).
+// Build with `make reconnect_storm`, then start the server and run
+//   ./bench/reconnect_storm <port> <password> [clients] [host]
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const double TIMEOUT_SECONDS = 60.0;
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum State { CONNECTING, REGISTERING, DONE, FAILED };
+
+struct Client {
+    int fd;
+    State state;
+    double connectedAt;
+    double registeredAt;
+    std::string input;
+};
+
+// Each client needs its own descriptor, so lift the soft limit as far as allowed
+static void raiseFileLimit(size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+    rlim_t target = static_cast<rlim_t>(wanted);
+    if (rl.rlim_max != RLIM_INFINITY && target > rl.rlim_max) target = rl.rlim_max;
+    if (rl.rlim_cur < target) {
+        rl.rlim_cur = target;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = static_cast<size_t>(p * (v.size() - 1));
+    return v[i];
+}
+
+static void fail(Client& c, size_t& pending) {
+    if (c.fd >= 0) close(c.fd);
+    c.fd = -1;
+    c.state = FAILED;
+    --pending;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <port> <password> [clients=10000] [host=127.0.0.1]\n", argv[0]);
+        return 1;
+    }
+    int port = std::atoi(argv[1]);
+    std::string password = argv[2];
+    size_t count = argc > 3 ? static_cast<size_t>(std::atol(argv[3])) : 10000;
+    const char* host = argc > 4 ? argv[4] : "127.0.0.1";
+
+    raiseFileLimit(count + 64);
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        std::fprintf(stderr, "Invalid host %s\n", host);
+        return 1;
+    }
+
+    std::vector<Client> clients(count);
+    size_t pending = count;
+    double start = nowSeconds();
+
+    // Fire every connect before servicing any of them
+    for (size_t i = 0; i < count; ++i) {
+        Client& c = clients[i];
+        c.state = CONNECTING;
+        c.connectedAt = 0;
+        c.registeredAt = 0;
+        c.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (c.fd < 0) {
+            fail(c, pending);
+            continue;
+        }
+        fcntl(c.fd, F_SETFL, O_NONBLOCK);
+        if (connect(c.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            fail(c, pending);
+        }
+    }
+    double issued = nowSeconds();
+
+    std::vector<pollfd> pfds;
+    std::vector<size_t> owners;
+    char buf[4096];
+    while (pending > 0 && nowSeconds() - start < TIMEOUT_SECONDS) {
+        pfds.clear();
+        owners.clear();
+        for (size_t i = 0; i < count; ++i) {
+            Client& c = clients[i];
+            if (c.state != CONNECTING && c.state != REGISTERING) continue;
+            pollfd p;
+            p.fd = c.fd;
+            p.events = c.state == CONNECTING ? POLLOUT : POLLIN;
+            p.revents = 0;
+            pfds.push_back(p);
+            owners.push_back(i);
+        }
+        if (poll(&pfds[0], pfds.size(), 100) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t k = 0; k < pfds.size(); ++k) {
+            if (pfds[k].revents == 0) continue;
+            Client& c = clients[owners[k]];
+            if (c.state == CONNECTING) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if (getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+                    fail(c, pending);
+                    continue;
+                }
+                c.connectedAt = nowSeconds();
+                char reg[128];
+                int n = std::snprintf(reg, sizeof(reg), "PASS %s\r\nNICK s%lu\r\nUSER s 0 * :storm\r\n",
+                                      password.c_str(), static_cast<unsigned long>(owners[k]));
+                if (send(c.fd, reg, n, 0) != n) {
+                    fail(c, pending);
+                    continue;
+                }
+                c.state = REGISTERING;
+                continue;
+            }
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                fail(c, pending);
+                continue;
+            }
+            c.input.append(buf, n);
+            if (c.input.find(" 001 ") != std::string::npos) {
+                c.registeredAt = nowSeconds();
+                c.state = DONE;
+                --pending;
+            }
+        }
+    }
+    double end = nowSeconds();
+
+    std::vector<double> connectLatency;
+    std::vector<double> registerLatency;
+    size_t failed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Client& c = clients[i];
+        if (c.state == DONE) {
+            connectLatency.push_back((c.connectedAt - start) * 1000.0);
+            registerLatency.push_back((c.registeredAt - start) * 1000.0);
+        } else {
+            ++failed;
+        }
+        if (c.fd >= 0) close(c.fd);
+    }
+
+    std::printf("clients %lu  registered %lu  failed %lu\n", static_cast<unsigned long>(count),
+                static_cast<unsigned long>(registerLatency.size()), static_cast<unsigned long>(failed));
+    std::printf("connects issued in %.1f ms, storm admitted in %.1f ms\n",
+                (issued - start) * 1000.0, (end - start) * 1000.0);
+    std::printf("%-10s %10s %10s %10s\n", "ms", "p50", "p99", "max");
+    std::printf("%-10s %10.1f %10.1f %10.1f\n", "connect", percentile(connectLatency, 0.5),
+                percentile(connectLatency, 0.99), percentile(connectLatency, 1.0));
+    std::printf("%-10s %10.1f %10.1f %10.1f\n", "register", percentile(registerLatency, 0.5),
+                percentile(registerLatency, 0.99), percentile(registerLatency, 1.0));
+    return failed == 0 ? 0 : 2;
+}
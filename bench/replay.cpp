@@ -0,0 +1,168 @@
+// Replays a traffic recording made with `ircserv --capture=FILE` through
+// the server's own framing and command dispatch, in-process (see
+// Server::setupOffline): every recorded connection becomes an offline
+// client, its lines are fed in as if read from its socket, and replies are
+// dropped. Run it under perf or valgrind to profile a real workload.
+//   ./bench/replay <capture> <password> [--speed=X] [--metrics] [--dump]
+// <password> must be the one the recorded server ran with. --speed=1
+// keeps the recorded timing, 2 doubles it; the default 0 replays as fast
+// as possible. Flood control is off, and timers (PING, registration
+// timeouts) do not run. --metrics prints the Prometheus text afterwards,
+// including per-command handler latency; --dump only lists the records.
+
+#include "../Server.hpp"
+#include "../Capture.hpp"
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void sleepUntil(long deadlineNs) {
+    struct timespec ts;
+    ts.tv_sec = deadlineNs / 1000000000L;
+    ts.tv_nsec = deadlineNs % 1000000000L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+// A recording of many concurrent clients needs as many descriptors
+static void raiseFileLimit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static const char* kindName(CaptureKind kind) {
+    switch (kind) {
+        case CAPTURE_CONNECT: return "CONNECT";
+        case CAPTURE_LINE: return "LINE";
+        case CAPTURE_DISCONNECT: return "DISCONNECT";
+        case CAPTURE_GAP: return "GAP";
+    }
+    return "?";
+}
+
+static int dump(CaptureReader& reader) {
+    CaptureRecord record;
+    while (reader.next(record)) {
+        std::printf("%12.3f %8lu %-10s %s\n", record.timeNs / 1e6, record.conn, kindName(record.kind),
+                    record.line.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <capture> <password> [--speed=X] [--metrics] [--dump]\n", argv[0]);
+        return 1;
+    }
+    double speed = 0;
+    bool metrics = false;
+    bool dumpOnly = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--speed=") == 0) speed = std::atof(arg.c_str() + 8);
+        else if (arg == "--metrics") metrics = true;
+        else if (arg == "--dump") dumpOnly = true;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Logger::start(LOG_LEVEL_ERROR);
+    int status = 0;
+    try {
+        CaptureReader reader(argv[1]);
+        if (dumpOnly) {
+            status = dump(reader);
+        } else {
+            raiseFileLimit();
+            ServerConfig config;
+            config.floodRate = 0;
+            Server server(0, argv[2], config);
+            server.setupOffline();
+
+            std::map<unsigned long, int> clients;          // Recorded connection id -> offline fd
+            std::string input;
+            unsigned long connections = 0, lines = 0, orphans = 0, lost = 0, outBytes = 0;
+            CaptureRecord record;
+            record.timeNs = 0;
+            long start = nowNs();
+            long busyNs = 0;
+            while (reader.next(record)) {
+                if (speed > 0) {
+                    sleepUntil(start + static_cast<long>(static_cast<double>(record.timeNs) / speed));
+                }
+                long began = nowNs();
+                std::map<unsigned long, int>::iterator it = clients.find(record.conn);
+                switch (record.kind) {
+                    case CAPTURE_CONNECT: {
+                        int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+                        if (fd < 0) throw std::runtime_error("Out of file descriptors");
+                        server.attachClient(fd);
+                        clients[record.conn] = fd;
+                        ++connections;
+                        break;
+                    }
+                    case CAPTURE_LINE:
+                        if (it == clients.end()) {
+                            // Connected before the recording started
+                            ++orphans;
+                            break;
+                        }
+                        input.assign(record.line);
+                        input += "\r\n";
+                        ++lines;
+                        if (!server.feedInput(it->second, input.data(), input.size())) {
+                            clients.erase(it);
+                        }
+                        break;
+                    case CAPTURE_DISCONNECT:
+                        if (it != clients.end()) {
+                            server.detachClient(it->second);
+                            clients.erase(it);
+                        }
+                        break;
+                    case CAPTURE_GAP:
+                        lost += record.conn;
+                        break;
+                }
+                outBytes += server.discardOutput();
+                busyNs += nowNs() - began;
+            }
+            double seconds = static_cast<double>(nowNs() - start) / 1e9;
+            std::printf("replayed %lu lines from %lu connections in %.3f s (%.1f ms recorded)\n", lines, connections,
+                        seconds, record.timeNs / 1e6);
+            std::printf("%.0f lines/s, %.1f ns per line in the server, %lu reply bytes\n",
+                        seconds > 0 ? lines / seconds : 0.0, lines > 0 ? static_cast<double>(busyNs) / lines : 0.0,
+                        outBytes);
+            if (orphans != 0 || lost != 0) {
+                std::printf("skipped %lu lines of unknown connections, %lu records lost during capture\n", orphans,
+                            lost);
+            }
+            if (metrics) {
+                std::string text;
+                server.renderMetrics(text);
+                std::fputs(text.c_str(), stdout);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        status = 1;
+    }
+    Logger::stop();
+    return status;
+}
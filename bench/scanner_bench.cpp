@@ -0,0 +1,100 @@
+// Line framing microbenchmark: the original std::string::find/substr/erase
+// loop against the LineScanner variants, at 1 KB, 64 KB and 1 MB inputs.
+// Build and run with `make scanner_bench && ./bench/scanner_bench`.
+
+#include "../LineScanner.hpp"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// IRC-looking traffic: PRIVMSG lines of 20 to 400 bytes, CRLF terminated
+static std::string makeInput(size_t size) {
+    std::string out;
+    srand(42);
+    while (out.size() < size) {
+        std::string line = "PRIVMSG #bench :";
+        size_t body = 20 + rand() % 380;
+        for (size_t i = 0; i < body; ++i) {
+            line += static_cast<char>('a' + rand() % 26);
+        }
+        line += "\r\n";
+        out += line;
+    }
+    out.resize(size);
+    return out;
+}
+
+static volatile size_t g_sink;
+
+// The framing loop handleClientData used before the read cursor: find, substr, erase
+static size_t frameLegacy(const std::string& input) {
+    std::string buffer = input;
+    size_t lines = 0;
+    size_t pos;
+    while ((pos = buffer.find("\n")) != std::string::npos) {
+        std::string message = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        g_sink += message.length();
+        lines++;
+    }
+    return lines;
+}
+
+typedef size_t (*ScanFunction)(const char*, size_t, bool&);
+
+static size_t frameWith(ScanFunction scan, const std::string& input) {
+    const char* data = input.data();
+    size_t avail = input.size();
+    size_t pos = 0;
+    size_t lines = 0;
+    while (pos < avail) {
+        bool hasNul;
+        size_t len = scan(data + pos, avail - pos, hasNul);
+        if (len == avail - pos) break;
+        g_sink += len + hasNul;
+        pos += len + 1;
+        lines++;
+    }
+    return lines;
+}
+
+static void report(const char* name, size_t size, size_t lines, double seconds, int reps) {
+    double perRep = seconds / reps;
+    std::printf("  %-12s %10.1f MB/s %10.1f ns/line\n", name,
+                size / perRep / (1024.0 * 1024.0), perRep * 1e9 / (lines ? lines : 1));
+}
+
+int main() {
+    const size_t sizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+    std::printf("dispatch: %s\n", lineScannerName());
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        std::string input = makeInput(sizes[s]);
+        // Roughly 64 MB of scanning per variant, fewer reps for the quadratic loop
+        int reps = static_cast<int>((64 * 1024 * 1024) / sizes[s]);
+        int legacyReps = sizes[s] >= 1024 * 1024 ? 4 : reps;
+        std::printf("%zu bytes:\n", sizes[s]);
+
+        double t = nowSeconds();
+        size_t lines = 0;
+        for (int r = 0; r < legacyReps; ++r) lines = frameLegacy(input);
+        report("string::find", sizes[s], lines, nowSeconds() - t, legacyReps);
+
+        const char* names[] = { "scalar", "sse2", "avx2" };
+        ScanFunction fns[] = { scanLineScalar, scanLineSse2, scanLineAvx2 };
+        for (size_t v = 0; v < 3; ++v) {
+            t = nowSeconds();
+            for (int r = 0; r < reps; ++r) lines = frameWith(fns[v], input);
+            report(names[v], sizes[s], lines, nowSeconds() - t, reps);
+        }
+    }
+    return 0;
+}
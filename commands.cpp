@@ -2,21 +2,31 @@
 #include "Server.hpp"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
 
 // Command handler implementations
 
+// Registration burst; the lines are queued together and leave in one write
+static void sendWelcome(Server* server, int fd, const ClientInfo& client) {
+    // The prefix without its leading ':' is nick!user@host
+    server->sendNumeric(fd, RPL_WELCOME, client.prefix.c_str() + 1);
+    server->sendNumeric(fd, RPL_YOURHOST, server->SERVER_NAME);
+    server->sendNumeric(fd, RPL_CREATED);
+    server->sendNumeric(fd, RPL_MYINFO, server->SERVER_NAME);
+    server->sendNumeric(fd, RPL_MOTDSTART, server->SERVER_NAME);
+    server->sendNumeric(fd, RPL_MOTD);
+    server->sendNumeric(fd, RPL_ENDOFMOTD);
+}
+
 void handlePass(Server* server, int fd, const std::vector<std::string>& params) {
-    if (params.empty()) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 * PASS :Not enough parameters"));
-        return;
-    }
-    
     ClientInfo& client = server->getClient(fd);
     if (params[0] == server->getPassword()) {
         client.authenticated = true;
         // std::cout << "Client " << fd << " authenticated" << std::endl;
     } else {
-        server->sendReply(fd, server->formatServerReply(fd, "464 * :Password incorrect"));
+        server->sendNumeric(fd, ERR_PASSWDMISMATCH);
     }
 }
 
@@ -25,12 +35,12 @@ void handleNick(Server* server, int fd, const std::vector<std::string>& params)
     
     // Check if client has authenticated first
     if (!client.authenticated) {
-        server->sendReply(fd, server->formatServerReply(fd, "464 * :Password required"));
+        server->sendNumeric(fd, ERR_PASSWDREQUIRED);
         return;
     }
     
     if (params.empty()) {
-        server->sendReply(fd, server->formatServerReply(fd, "431 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :No nickname given"));
+        server->sendNumeric(fd, ERR_NONICKNAMEGIVEN);
         return;
     }
 
@@ -38,29 +48,26 @@ void handleNick(Server* server, int fd, const std::vector<std::string>& params)
     
     // Validate nickname format
     if (!isValidNickname(new_nick)) {
-        server->sendReply(fd, server->formatServerReply(fd, "432 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " " + new_nick + " :Erroneous nickname"));
+        server->sendNumeric(fd, ERR_ERRONEUSNICKNAME, new_nick);
         return;
     }
     
     // Check if nickname is already in use by another client
-    std::map<int, ClientInfo>& clients = server->getClients();
-    for (std::map<int, ClientInfo>::iterator it = clients.begin(); 
-         it != clients.end(); ++it) {
-        if (it->first != fd && it->second.nickname == new_nick) {
-            server->sendReply(fd, server->formatServerReply(fd, "433 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " " + new_nick + " :Nickname is already in use"));
-            return;
-        }
+    int owner = server->getClientFdByNick(new_nick);
+    if (owner != -1 && owner != fd) {
+        server->sendNumeric(fd, ERR_NICKNAMEINUSE, new_nick);
+        return;
     }
     
+    // The NICK line carries the old prefix, so build it before the change
+    std::string nick_msg = client.prefix + " NICK :" + new_nick + "\r\n";
     std::string old_nick = client.nickname;
-    client.nickname = new_nick;
+    server->setNickname(fd, new_nick);
     
     // If user was already registered, notify channels about nick change
     if (client.registered && !old_nick.empty()) {
-        std::string nick_msg = ":" + old_nick + "!" + client.username + "@" + client.hostname + " NICK :" + new_nick + "\r\n";
-        for (std::set<std::string>::iterator it = client.channels.begin(); 
-             it != client.channels.end(); ++it) {
-            server->broadcastToChannel(*it, nick_msg, -1);
+        for (size_t i = 0; i < client.channels.size(); ++i) {
+            server->broadcastToChannel(server->getChannel(client.channels[i]), nick_msg, -1);
         }
         server->sendReply(fd, nick_msg);
     }
@@ -70,13 +77,7 @@ void handleNick(Server* server, int fd, const std::vector<std::string>& params)
     // Check if we can complete registration (only if not already registered)
     if (!client.registered && client.authenticated && !client.nickname.empty() && !client.username.empty()) {
         client.registered = true;
-        server->sendReply(fd, server->formatServerReply(fd, "001 " + client.nickname + " :Welcome to the IRC Network " + client.nickname + "!" + client.username + "@" + client.hostname));
-        server->sendReply(fd, server->formatServerReply(fd, "002 " + client.nickname + " :Your host is " + server->SERVER_NAME + ", running version 1.0"));
-        server->sendReply(fd, server->formatServerReply(fd, "003 " + client.nickname + " :This server was created today"));
-        server->sendReply(fd, server->formatServerReply(fd, "004 " + client.nickname + " " + server->SERVER_NAME + " 1.0 o o"));
-        server->sendReply(fd, server->formatServerReply(fd, "375 " + client.nickname + " :- " + server->SERVER_NAME + " Message of the day -"));
-        server->sendReply(fd, server->formatServerReply(fd, "372 " + client.nickname + " :- Welcome to our IRC server!"));
-        server->sendReply(fd, server->formatServerReply(fd, "376 " + client.nickname + " :End of MOTD command"));
+        sendWelcome(server, fd, client);
         // std::cout << "Client " << fd << " completed registration as " << client.nickname << std::endl;
     }
 }
@@ -86,53 +87,34 @@ void handleUser(Server* server, int fd, const std::vector<std::string>& params)
     
     // Check if client has authenticated first
     if (!client.authenticated) {
-        server->sendReply(fd, server->formatServerReply(fd, "464 * :Password required"));
+        server->sendNumeric(fd, ERR_PASSWDREQUIRED);
         return;
     }
     
     // Reject USER command if already registered
     if (client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "462 " + client.nickname + " :You may not reregister"));
+        server->sendNumeric(fd, ERR_ALREADYREGISTERED);
         return;
     }
     
-    if (params.size() < 4) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " USER :Not enough parameters"));
-        return;
-    }
-
     client.username = params[0];
     client.hostname = "localhost";
     client.realname = params[3];
+    client.updatePrefix();
     
     // std::cout << "Client " << fd << " set user info: " << client.username << std::endl;
     
     // Check if we can complete registration (only if not already registered)
     if (!client.registered && client.authenticated && !client.nickname.empty() && !client.username.empty()) {
         client.registered = true;
-        server->sendReply(fd, server->formatServerReply(fd, "001 " + client.nickname + " :Welcome to the IRC Network " + client.nickname + "!" + client.username + "@" + client.hostname));
-        server->sendReply(fd, server->formatServerReply(fd, "002 " + client.nickname + " :Your host is " + server->SERVER_NAME + ", running version 1.0"));
-        server->sendReply(fd, server->formatServerReply(fd, "003 " + client.nickname + " :This server was created today"));
-        server->sendReply(fd, server->formatServerReply(fd, "004 " + client.nickname + " " + server->SERVER_NAME + " 1.0 o o"));
-        server->sendReply(fd, server->formatServerReply(fd, "375 " + client.nickname + " :- " + server->SERVER_NAME + " Message of the day -"));
-        server->sendReply(fd, server->formatServerReply(fd, "372 " + client.nickname + " :- Welcome to our IRC server!"));
-        server->sendReply(fd, server->formatServerReply(fd, "376 " + client.nickname + " :End of MOTD command"));
+        sendWelcome(server, fd, client);
         // std::cout << "Client " << fd << " completed registration as " << client.nickname << std::endl;
     }
 }
 
 void handleJoin(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
     
-    if (params.empty()) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " JOIN :Not enough parameters"));
-        return;
-    }
-
     // Parse channels and keys
     std::vector<std::string> channels = splitByComma(params[0]);
     std::vector<std::string> keys;
@@ -141,9 +123,6 @@ void handleJoin(Server* server, int fd, const std::vector<std::string>& params)
         keys = splitByComma(params[1]);
     }
     
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    std::map<int, ClientInfo>& clientMap = server->getClients();
-    
     // Join each channel
     for (size_t i = 0; i < channels.size(); ++i) {
         std::string channel = channels[i];
@@ -160,70 +139,54 @@ void handleJoin(Server* server, int fd, const std::vector<std::string>& params)
             channel = "#" + channel;
         }
         
-        // Check if already in channel
-        if (client.channels.find(channel) != client.channels.end()) {
-            continue; // Already in this channel, skip
-        }
-        
         // Check if channel exists and has restrictions
-        bool channelExists = channelMap.find(channel) != channelMap.end();
+        ChannelInfo* existing = server->findChannel(channel);
         
-        if (channelExists) {
-            ChannelInfo& chanInfo = channelMap[channel];
+        if (existing != NULL) {
+            ChannelInfo& chanInfo = *existing;
+            
+            // Check if already in channel
+            if (chanInfo.hasMember(fd)) {
+                continue; // Already in this channel, skip
+            }
             
             // Check invite-only mode
             if (chanInfo.inviteOnly) {
                 // Check if user is invited
-                if (chanInfo.invited.find(fd) == chanInfo.invited.end()) {
-                    server->sendReply(fd, server->formatServerReply(fd, "473 " + client.nickname + " " + channel + " :Cannot join channel (+i)"));
+                if (!chanInfo.isInvited(fd)) {
+                    server->sendNumeric(fd, ERR_INVITEONLYCHAN, channel);
                     continue; // Skip this channel
                 }
                 // User is invited, remove from invite list after successful join attempt
-                chanInfo.invited.erase(fd);
+                chanInfo.uninvite(fd);
             }
             
             // Check user limit
             if (chanInfo.userLimit > 0 && chanInfo.members.size() >= chanInfo.userLimit) {
-                server->sendReply(fd, server->formatServerReply(fd, "471 " + client.nickname + " " + channel + " :Cannot join channel (+l)"));
+                server->sendNumeric(fd, ERR_CHANNELISFULL, channel);
                 continue; // Skip this channel
             }
             
             // Check key (password)
             if (!chanInfo.key.empty()) {
                 if (key != chanInfo.key) {
-                    server->sendReply(fd, server->formatServerReply(fd, "475 " + client.nickname + " " + channel + " :Cannot join channel (+k)"));
+                    server->sendNumeric(fd, ERR_BADCHANNELKEY, channel);
                     continue; // Skip this channel
                 }
             }
         }
         
-        // Add user to channel
-        client.channels.insert(channel);
-        channelMap[channel].members.insert(fd);
-        
-        // If first member, make them operator
-        if (channelMap[channel].members.size() == 1) {
-            channelMap[channel].operators.insert(fd);
-        }
+        // Add user to channel; the first member becomes operator
+        ChannelInfo& joined = server->joinChannel(fd, channel);
         
         // Then notify all members (including the one who just joined) about the JOIN
-        std::string join_msg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " JOIN :" + channel + "\r\n";
-        server->broadcastToChannel(channel, join_msg, -1); // Send to everyone including the joiner
-        
-        // Build list of all users in the channel (including the one who just joined)
-        std::string names = "";
-        for (std::set<int>::iterator it = channelMap[channel].members.begin(); 
-             it != channelMap[channel].members.end(); ++it) {
-            if (!names.empty()) names += " ";
-            // Add @ prefix for operators
-            if (channelMap[channel].operators.find(*it) != channelMap[channel].operators.end()) {
-                names += "@";
-            }
-            names += clientMap[*it].nickname;
-        }
+        ReplyBuilder line(server->scratch());
+        line.append(client.prefix).append(" JOIN :").append(channel);
+        MessageRef join_msg(line.finish());
+        server->broadcastToChannel(joined, join_msg.get(), -1); // Send to everyone including the joiner
         
-        server->sendReply(fd, server->formatServerReply(fd, "353 " + client.nickname + " = " + channel + " :" + names));
-        server->sendReply(fd, server->formatServerReply(fd, "366 " + client.nickname + " " + channel + " :End of NAMES list"));
+        // List everyone in the channel, including the one who just joined
+        server->sendNames(fd, &joined, channel);
         
         // std::cout << "Client " << client.nickname << " joined " << channel << std::endl;
     }
@@ -231,50 +194,39 @@ void handleJoin(Server* server, int fd, const std::vector<std::string>& params)
 
 void handlePrivMsg(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
     
-    if (params.size() < 2) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " PRIVMSG :Not enough parameters"));
-        return;
-    }
-
-    std::string target = params[0];
-    std::string message = params[1];
-    
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    std::map<int, ClientInfo>& clientMap = server->getClients();
+    const std::string& target = params[0];
+    const std::string& message = params[1];
+    ReplyBuilder reply(server->scratch());
     
     if (target[0] == '#') {
         // Channel message
-        if (channelMap.find(target) == channelMap.end()) {
-            server->sendReply(fd, server->formatServerReply(fd, "403 " + client.nickname + " " + target + " :No such channel"));
+        ChannelInfo* chanInfo = server->findChannel(target);
+        if (chanInfo == NULL) {
+            server->sendNumeric(fd, ERR_NOSUCHCHANNEL, target);
             return;
         }
         
         // Check if sender is a member of the channel
-        if (client.channels.find(target) == client.channels.end()) {
-            server->sendReply(fd, server->formatServerReply(fd, "442 " + client.nickname + " " + target + " :You're not on that channel"));
+        if (!chanInfo->hasMember(fd)) {
+            server->sendNumeric(fd, ERR_NOTONCHANNEL, target);
             return;
         }
         
-        std::string msg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " PRIVMSG " + target + " :" + message + "\r\n";
-        server->broadcastToChannel(target, msg, fd);
+        reply.append(client.prefix).append(" PRIVMSG ").append(target).append(" :").append(message);
+        MessageRef msg(reply.finish());
+        server->broadcastToChannel(*chanInfo, msg.get(), fd);
         // std::cout << "Channel " << target << " <" << client.nickname << "> " << message << std::endl;
     } else {
         // Private message to user
-        for (std::map<int, ClientInfo>::iterator it = clientMap.begin(); 
-             it != clientMap.end(); ++it) {
-            if (it->second.nickname == target) {
-                std::string msg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " PRIVMSG " + target + " :" + message + "\r\n";
-                server->sendReply(it->first, msg);
-                // std::cout << "Private <" << client.nickname << " -> " << target << "> " << message << std::endl;
-                return;
-            }
+        int target_fd = server->getClientFdByNick(target);
+        if (target_fd != -1) {
+            reply.append(client.prefix).append(" PRIVMSG ").append(target).append(" :").append(message);
+            server->sendReply(target_fd, reply);
+            // std::cout << "Private <" << client.nickname << " -> " << target << "> " << message << std::endl;
+            return;
         }
-        server->sendReply(fd, server->formatServerReply(fd, "401 " + client.nickname + " " + target + " :No such nick"));
+        server->sendNumeric(fd, ERR_NOSUCHNICK, target);
     }
 }
 
@@ -285,40 +237,40 @@ void handleQuit(Server* server, int fd, const std::vector<std::string>& params)
         quit_msg = params[0];
     }
     
-    std::cout << "Client " << client.nickname << " quit: " << quit_msg << std::endl;
-    server->removeClient(fd);
+    LOG_INFO("Client " << client.nickname << " quit: " << quit_msg);
+    server->removeClient(fd, DISCONNECT_QUIT);
 }
 
 void handlePing(Server* server, int fd, const std::vector<std::string>& params) {
     if (params.empty()) {
-        ClientInfo& client = server->getClient(fd);
-        server->sendReply(fd, server->formatServerReply(fd, "409 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :No origin specified"));
+        server->sendNumeric(fd, ERR_NOORIGIN);
         return;
     }
     
     // Respond with PONG
-    server->sendReply(fd, ":" + server->SERVER_NAME + " PONG " + server->SERVER_NAME + " :" + params[0] + "\r\n");
+    ReplyBuilder reply(server->scratch());
+    reply.append(':').append(server->SERVER_NAME).append(" PONG ").append(server->SERVER_NAME).append(" :").append(params[0]);
+    server->sendReply(fd, reply);
+}
+
+// Answers our keepalive PING. Receiving it already counted as activity.
+void handlePong(Server* server, int fd, const std::vector<std::string>& params) {
+    (void)server;
+    (void)fd;
+    (void)params;
 }
 
 void handlePart(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
     
-    if (params.empty()) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " PART :Not enough parameters"));
-        return;
-    }
-
     std::string channel = params[0];
     if (channel[0] != '#') {
         channel = "#" + channel;
     }
     
-    if (client.channels.find(channel) == client.channels.end()) {
-        server->sendReply(fd, server->formatServerReply(fd, "442 " + client.nickname + " " + channel + " :You're not on that channel"));
+    ChannelInfo* chanInfo = server->findChannel(channel);
+    if (chanInfo == NULL || !chanInfo->hasMember(fd)) {
+        server->sendNumeric(fd, ERR_NOTONCHANNEL, channel);
         return;
     }
     
@@ -327,57 +279,40 @@ void handlePart(Server* server, int fd, const std::vector<std::string>& params)
         part_msg = params[1];
     }
     
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    
-    client.channels.erase(channel);
-    channelMap[channel].members.erase(fd);
-    channelMap[channel].operators.erase(fd);
+    ReplyBuilder line(server->scratch());
+    line.append(client.prefix).append(" PART ").append(channel).append(" :").append(part_msg);
+    MessageRef msg(line.finish());
+    server->broadcastToChannel(*chanInfo, msg.get(), -1); // Send to all including the one leaving
     
-    std::string msg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + " PART " + channel + " :" + part_msg + "\r\n";
-    server->broadcastToChannel(channel, msg, -1); // Send to all including the one leaving
-    
-    if (channelMap[channel].members.empty()) {
-        channelMap.erase(channel);
-    }
+    server->leaveChannel(fd, *chanInfo);
     
     // std::cout << "Client " << client.nickname << " left " << channel << std::endl;
 }
 
 void handleMode(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
-    
-    if (params.empty()) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " MODE :Not enough parameters"));
-        return;
-    }
     
     std::string target = params[0];
     
     if (target[0] == '#') {
         // Channel mode
-        std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-        std::map<std::string, ChannelInfo>::iterator chanIt = channelMap.find(target);
-        if (chanIt == channelMap.end()) {
-            server->sendReply(fd, server->formatServerReply(fd, "403 " + client.nickname + " " + target + " :No such channel"));
+        ChannelInfo* found = server->findChannel(target);
+        if (found == NULL) {
+            server->sendNumeric(fd, ERR_NOSUCHCHANNEL, target);
             return;
         }
         
-        ChannelInfo& channel = chanIt->second;
+        ChannelInfo& channel = *found;
         
         // Check if user is in the channel
-        if (!server->isClientInChannel(target, fd)) {
-            server->sendReply(fd, server->formatServerReply(fd, "442 " + client.nickname + " " + target + " :You're not on that channel"));
+        if (!channel.hasMember(fd)) {
+            server->sendNumeric(fd, ERR_NOTONCHANNEL, target);
             return;
         }
         
         // If no mode string provided, just show current modes
         if (params.size() == 1) {
-            std::string modeStr = channel.getModeString();
-            std::string response = "324 " + client.nickname + " " + target + " " + modeStr;
+            std::string response = channel.getModeString();
             
             // Add key if present
             if (!channel.key.empty()) {
@@ -389,7 +324,7 @@ void handleMode(Server* server, int fd, const std::vector<std::string>& params)
                 oss << channel.userLimit;
                 response += " " + oss.str();
             }
-            server->sendReply(fd, server->formatServerReply(fd, response));
+            server->sendNumeric(fd, RPL_CHANNELMODEIS, target, response);
             return;
         }
         
@@ -410,8 +345,8 @@ void handleMode(Server* server, int fd, const std::vector<std::string>& params)
         }
         
         // Check if user is channel operator (only for supported modes)
-        if (!server->isChannelOperator(target, fd)) {
-            server->sendReply(fd, server->formatServerReply(fd, "482 " + client.nickname + " " + target + " :You're not channel operator"));
+        if (!channel.isOperator(fd)) {
+            server->sendNumeric(fd, ERR_CHANOPRIVSNEEDED, target);
             return;
         }
         
@@ -476,12 +411,8 @@ void handleMode(Server* server, int fd, const std::vector<std::string>& params)
                     std::string targetNick = params[paramIndex];
                     int targetFd = server->getClientFdByNick(targetNick);
                     
-                    if (targetFd != -1 && server->isClientInChannel(target, targetFd)) {
-                        if (adding) {
-                            channel.operators.insert(targetFd);
-                        } else {
-                            channel.operators.erase(targetFd);
-                        }
+                    if (targetFd != -1 && channel.hasMember(targetFd)) {
+                        channel.setMemberMode(targetFd, MEMBER_OP, adding);
                         modeChanges += "o";
                         if (!modeParams.empty()) modeParams += " ";
                         modeParams += targetNick;
@@ -494,13 +425,13 @@ void handleMode(Server* server, int fd, const std::vector<std::string>& params)
         
         // Broadcast mode change to channel
         if (!modeChanges.empty() && modeChanges != "+" && modeChanges != "-") {
-            std::string modeMsg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + 
+            std::string modeMsg = client.prefix + 
                                 " MODE " + target + " " + modeChanges;
             if (!modeParams.empty()) {
                 modeMsg += " " + modeParams;
             }
             modeMsg += "\r\n";
-            server->broadcastToChannel(target, modeMsg, -1);
+            server->broadcastToChannel(channel, modeMsg, -1);
         }
     }
     // } else {
@@ -509,80 +440,101 @@ void handleMode(Server* server, int fd, const std::vector<std::string>& params)
     // }
 }
 
-void handleWho(Server* server, int fd, const std::vector<std::string>& params) {
-    ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, "451 :You have not registered\r\n");
-        return;
+// Members one WHO step replies for, and channel ids one LIST step looks at
+static const size_t WHO_BATCH = 256;
+static const ChannelId LIST_SCAN_BUDGET = 1024;
+
+// WHO on a channel, resumed by fd. Members are sorted by fd, so joins and
+// parts between steps neither repeat nor skip anyone who stays.
+class WhoTask : public Task {
+public:
+    explicit WhoTask(const std::string& channel) : _channel(channel), _nextFd(0) {}
+
+    virtual bool step(Server& server, int fd) {
+        ChannelInfo* chanInfo = server.findChannel(_channel);
+        if (chanInfo != NULL) {
+            const std::vector<ChannelMember>& members = chanInfo->members;
+            size_t i = chanInfo->memberSlot(_nextFd);
+            for (size_t sent = 0; i < members.size() && sent < WHO_BATCH; ++i, ++sent) {
+                if (server.outputBacklogged(fd)) return true;
+                ClientInfo& target_client = server.getClient(members[i].fd);
+                server.sendNumeric(fd, RPL_WHOREPLY, _channel, target_client.username, target_client.hostname,
+                                    target_client.nickname, target_client.realname);
+                _nextFd = members[i].fd + 1;
+            }
+            if (i < members.size()) return true;
+        }
+        server.sendNumeric(fd, RPL_ENDOFWHO, _channel);
+        return false;
     }
-    
+
+private:
+    std::string _channel;
+    int _nextFd;
+};
+
+void handleWho(Server* server, int fd, const std::vector<std::string>& params) {
     if (params.empty()) {
-        server->sendReply(fd, "315 " + client.nickname + " * :End of WHO list\r\n");
+        server->sendNumeric(fd, RPL_ENDOFWHO, "*");
         return;
     }
     
     std::string target = params[0];
     
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    std::map<int, ClientInfo>& clientMap = server->getClients();
-    
     if (target[0] == '#') {
-        // Channel WHO
-        std::map<std::string, ChannelInfo>::iterator it = channelMap.find(target);
-        if (it != channelMap.end()) {
-            for (std::set<int>::iterator client_it = it->second.members.begin(); 
-                 client_it != it->second.members.end(); ++client_it) {
-                ClientInfo& target_client = clientMap[*client_it];
-                server->sendReply(fd, "352 " + client.nickname + " " + target + " " + 
-                         target_client.username + " " + target_client.hostname + 
-                         " ircserver " + target_client.nickname + " H :0 " + 
-                         target_client.realname + "\r\n");
-            }
-        }
-        server->sendReply(fd, "315 " + client.nickname + " " + target + " :End of WHO list\r\n");
+        // Channel WHO, in steps for large channels
+        server->startTask(fd, new WhoTask(target));
     } else {
-        server->sendReply(fd, "315 " + client.nickname + " " + target + " :End of WHO list\r\n");
+        server->sendNumeric(fd, RPL_ENDOFWHO, target);
     }
 }
 
-void handleList(Server* server, int fd, const std::vector<std::string>& params) {
-    (void)params; // Unused parameter
-    ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, "451 :You have not registered\r\n");
-        return;
+// LIST as a cursor over channel ids. Ids are reused, so channels created or
+// destroyed while it runs may or may not be listed.
+class ListTask : public Task {
+public:
+    explicit ListTask(const ChannelFilter& filter) : _filter(filter), _next(0) {}
+
+    virtual bool step(Server& server, int fd) {
+        ChannelTable& channels = server.getChannels();
+        ChannelId limit = channels.idLimit();
+        ChannelId stop = limit - _next > LIST_SCAN_BUDGET ? _next + LIST_SCAN_BUDGET : limit;
+        for (; _next < stop; ++_next) {
+            // The count index rules out free ids and count filters without
+            // touching the channel itself
+            size_t members = channels.memberCount(_next);
+            if (members == 0 || !_filter.matchesCount(members)) continue;
+            const ChannelInfo& channel = *channels.get(_next);
+            if (!_filter.matchesName(channel.name)) continue;
+            if (server.outputBacklogged(fd)) return true;
+            server.sendNumeric(fd, RPL_LIST, channel.name, members,
+                               channel.topic.empty() ? NumericArg("No topic") : NumericArg(channel.topic));
+        }
+        if (_next < limit) return true;
+        server.sendNumeric(fd, RPL_LISTEND);
+        return false;
     }
-    
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    
-    server->sendReply(fd, "321 " + client.nickname + " Channel :Users  Name\r\n");
-    
-    for (std::map<std::string, ChannelInfo>::iterator it = channelMap.begin(); 
-         it != channelMap.end(); ++it) {
-        std::ostringstream oss;
-        oss << it->second.members.size();
-        
-        // Include actual topic if set, otherwise show "No topic"
-        std::string topic = it->second.topic.empty() ? "No topic" : it->second.topic;
-        
-        server->sendReply(fd, "322 " + client.nickname + " " + it->first + " " + 
-                 oss.str() + " :" + topic + "\r\n");
+
+private:
+    ChannelFilter _filter;
+    ChannelId _next;                // First channel id not looked at yet
+};
+
+void handleList(Server* server, int fd, const std::vector<std::string>& params) {
+    // ELIST conditions, e.g. "LIST >10,#irc*"; the reply streams in steps
+    ChannelFilter filter;
+    if (!params.empty()) {
+        std::vector<std::string> conditions = splitByComma(params[0]);
+        for (size_t i = 0; i < conditions.size(); ++i) {
+            filter.addCondition(conditions[i]);
+        }
     }
-    
-    server->sendReply(fd, "323 " + client.nickname + " :End of LIST\r\n");
+    server->sendNumeric(fd, RPL_LISTSTART);
+    server->startTask(fd, new ListTask(filter));
 }
 
 void handleKick(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
-    
-    if (params.size() < 2) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " KICK :Not enough parameters"));
-        return;
-    }
     
     std::string channel = params[0];
     std::string targetNick = params[1];
@@ -596,74 +548,52 @@ void handleKick(Server* server, int fd, const std::vector<std::string>& params)
         channel = "#" + channel;
     }
     
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    
     // Check if channel exists
-    std::map<std::string, ChannelInfo>::iterator chanIt = channelMap.find(channel);
-    if (chanIt == channelMap.end()) {
-        server->sendReply(fd, server->formatServerReply(fd, "403 " + client.nickname + " " + channel + " :No such channel"));
+    ChannelInfo* found = server->findChannel(channel);
+    if (found == NULL) {
+        server->sendNumeric(fd, ERR_NOSUCHCHANNEL, channel);
         return;
     }
     
-    ChannelInfo& chanInfo = chanIt->second;
+    ChannelInfo& chanInfo = *found;
     
     // Check if kicker is in the channel
-    if (!server->isClientInChannel(channel, fd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "442 " + client.nickname + " " + channel + " :You're not on that channel"));
+    if (!chanInfo.hasMember(fd)) {
+        server->sendNumeric(fd, ERR_NOTONCHANNEL, channel);
         return;
     }
     
     // Check if kicker is channel operator
-    if (!server->isChannelOperator(channel, fd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "482 " + client.nickname + " " + channel + " :You're not channel operator"));
+    if (!chanInfo.isOperator(fd)) {
+        server->sendNumeric(fd, ERR_CHANOPRIVSNEEDED, channel);
         return;
     }
     
     // Find target user
     int targetFd = server->getClientFdByNick(targetNick);
     if (targetFd == -1) {
-        server->sendReply(fd, server->formatServerReply(fd, "401 " + client.nickname + " " + targetNick + " :No such nick/channel"));
+        server->sendNumeric(fd, ERR_NOSUCHNICK, targetNick);
         return;
     }
     
     // Check if target is in the channel
-    if (!server->isClientInChannel(channel, targetFd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "441 " + client.nickname + " " + targetNick + " " + channel + " :They aren't on that channel"));
+    if (!chanInfo.hasMember(targetFd)) {
+        server->sendNumeric(fd, ERR_USERNOTINCHANNEL, targetNick, channel);
         return;
     }
     
-    std::map<int, ClientInfo>& clientMap = server->getClients();
-    
-    // Get target client info
-    ClientInfo& targetClient = clientMap[targetFd];
-    
     // Broadcast KICK message to all channel members (including the kicked user)
-    std::string kickMsg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + 
-                         " KICK " + channel + " " + targetNick + " :" + reason + "\r\n";
-    server->broadcastToChannel(channel, kickMsg, -1);
-    
-    // Remove user from channel
-    targetClient.channels.erase(channel);
-    chanInfo.members.erase(targetFd);
-    chanInfo.operators.erase(targetFd);
+    ReplyBuilder line(server->scratch());
+    line.append(client.prefix).append(" KICK ").append(channel).append(' ').append(targetNick).append(" :").append(reason);
+    MessageRef kickMsg(line.finish());
+    server->broadcastToChannel(chanInfo, kickMsg.get(), -1);
     
-    // If channel is empty, delete it
-    if (chanInfo.members.empty()) {
-        channelMap.erase(channel);
-    }
+    // Remove user from channel, deleting it if that left it empty
+    server->leaveChannel(targetFd, chanInfo);
 }
 
 void handleInvite(Server* server, int fd, const std::vector<std::string>& params) {
     ClientInfo& client = server->getClient(fd);
-    if (!client.registered) {
-        server->sendReply(fd, server->formatServerReply(fd, "451 " + (client.nickname.empty() ? std::string("*") : client.nickname) + " :You have not registered"));
-        return;
-    }
-    
-    if (params.size() < 2) {
-        server->sendReply(fd, server->formatServerReply(fd, "461 " + client.nickname + " INVITE :Not enough parameters"));
-        return;
-    }
     
     std::string targetNick = params[0];
     std::string channel = params[1];
@@ -673,50 +603,311 @@ void handleInvite(Server* server, int fd, const std::vector<std::string>& params
         channel = "#" + channel;
     }
     
-    std::map<std::string, ChannelInfo>& channelMap = server->getChannels();
-    
     // Check if channel exists
-    std::map<std::string, ChannelInfo>::iterator chanIt = channelMap.find(channel);
-    if (chanIt == channelMap.end()) {
-        server->sendReply(fd, server->formatServerReply(fd, "403 " + client.nickname + " " + channel + " :No such channel"));
+    ChannelInfo* found = server->findChannel(channel);
+    if (found == NULL) {
+        server->sendNumeric(fd, ERR_NOSUCHCHANNEL, channel);
         return;
     }
     
-    ChannelInfo& chanInfo = chanIt->second;
+    ChannelInfo& chanInfo = *found;
     
     // Check if inviter is in the channel
-    if (!server->isClientInChannel(channel, fd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "442 " + client.nickname + " " + channel + " :You're not on that channel"));
+    if (!chanInfo.hasMember(fd)) {
+        server->sendNumeric(fd, ERR_NOTONCHANNEL, channel);
         return;
     }
     
     // If channel is invite-only, only operators can invite
-    if (chanInfo.inviteOnly && !server->isChannelOperator(channel, fd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "482 " + client.nickname + " " + channel + " :You're not channel operator"));
+    if (chanInfo.inviteOnly && !chanInfo.isOperator(fd)) {
+        server->sendNumeric(fd, ERR_CHANOPRIVSNEEDED, channel);
         return;
     }
     
     // Find target user
     int targetFd = server->getClientFdByNick(targetNick);
     if (targetFd == -1) {
-        server->sendReply(fd, server->formatServerReply(fd, "401 " + client.nickname + " " + targetNick + " :No such nick/channel"));
+        server->sendNumeric(fd, ERR_NOSUCHNICK, targetNick);
         return;
     }
     
     // Check if target is already in the channel
-    if (server->isClientInChannel(channel, targetFd)) {
-        server->sendReply(fd, server->formatServerReply(fd, "443 " + client.nickname + " " + targetNick + " " + channel + " :is already on channel"));
+    if (chanInfo.hasMember(targetFd)) {
+        server->sendNumeric(fd, ERR_USERONCHANNEL, targetNick, channel);
         return;
     }
     
     // Add user to invite list
-    chanInfo.invited.insert(targetFd);
+    chanInfo.invite(targetFd);
     
     // Send invite notification to target user
-    std::string inviteMsg = ":" + client.nickname + "!" + client.username + "@" + client.hostname + 
+    std::string inviteMsg = client.prefix + 
                            " INVITE " + targetNick + " :" + channel + "\r\n";
     server->sendReply(targetFd, inviteMsg);
     
     // Confirm to inviter
-    server->sendReply(fd, server->formatServerReply(fd, "341 " + client.nickname + " " + targetNick + " " + channel));
+    server->sendNumeric(fd, RPL_INVITING, targetNick, channel);
+}
+
+void handleCap(Server* server, int fd, const std::vector<std::string>& params) {
+    // CAP (Client Capability) command for modern IRC clients like irssi
+    if (params.empty()) {
+        return;
+    }
+    std::string subcmd = params[0];
+    std::transform(subcmd.begin(), subcmd.end(), subcmd.begin(), ::toupper);
+    if (subcmd == "LS") {
+        server->sendReply(fd, "CAP * LS :\r\n");
+    } else if (subcmd == "END") {
+        // No response needed for CAP END
+    } else if (subcmd == "REQ") {
+        // Client requesting capabilities - we don't support any
+        server->sendReply(fd, "CAP * NAK\r\n");
+    }
+}
+
+void handleTopic(Server* server, int fd, const std::vector<std::string>& params) {
+    ClientInfo& client = server->getClient(fd);
+    std::string channel = params[0];
+    
+    // Check if channel exists
+    ChannelInfo* found = server->findChannel(channel);
+    if (found == NULL) {
+        server->sendNumeric(fd, ERR_NOSUCHCHANNEL, channel);
+        return;
+    }
+    
+    ChannelInfo& chanInfo = *found;
+    
+    // Check if user is in the channel
+    if (!chanInfo.hasMember(fd)) {
+        server->sendNumeric(fd, ERR_NOTONCHANNEL, channel);
+        return;
+    }
+    
+    if (params.size() > 1) {
+        // Set topic
+        // Check if topic is restricted to operators (+t mode)
+        if (chanInfo.topicRestricted) {
+            // Only operators can set the topic when +t is enabled
+            if (!chanInfo.isOperator(fd)) {
+                server->sendNumeric(fd, ERR_CHANOPRIVSNEEDED, channel);
+                return;
+            }
+        }
+        
+        // Set the new topic
+        std::string newTopic = params[1];
+        chanInfo.topic = newTopic;
+        
+        // Broadcast topic change to all channel members
+        ReplyBuilder line(server->scratch());
+        line.append(client.prefix).append(" TOPIC ").append(channel).append(" :").append(newTopic);
+        MessageRef topicMsg(line.finish());
+        server->broadcastToChannel(chanInfo, topicMsg.get(), -1);
+    } else {
+        // Get topic
+        if (chanInfo.topic.empty()) {
+            server->sendNumeric(fd, RPL_NOTOPIC, channel);
+        } else {
+            server->sendNumeric(fd, RPL_TOPIC, channel, chanInfo.topic);
+        }
+    }
+}
+
+void handleNames(Server* server, int fd, const std::vector<std::string>& params) {
+    if (params.empty()) {
+        return;
+    }
+    
+    std::string channel = params[0];
+    server->sendNames(fd, server->findChannel(channel), channel);
+}
+
+void handleWhois(Server* server, int fd, const std::vector<std::string>& params) {
+    if (params.empty()) {
+        server->sendNumeric(fd, ERR_NONICKNAMEGIVEN);
+        return;
+    }
+    
+    std::string target_nick = params[0];
+    int target_fd = server->getClientFdByNick(target_nick);
+    if (target_fd == -1) {
+        server->sendNumeric(fd, ERR_NOSUCHNICK, target_nick);
+        server->sendNumeric(fd, RPL_ENDOFWHOIS, target_nick);
+        return;
+    }
+    
+    ClientInfo& target = server->getClient(target_fd);
+    server->sendNumeric(fd, RPL_WHOISUSER, target.nickname, target.username, target.hostname, target.realname);
+    // List channels the user is in
+    if (!target.channels.empty()) {
+        std::string channels_list = "";
+        for (size_t i = 0; i < target.channels.size(); ++i) {
+            if (!channels_list.empty()) channels_list += " ";
+            channels_list += server->getChannel(target.channels[i]).name;
+        }
+        server->sendNumeric(fd, RPL_WHOISCHANNELS, target.nickname, channels_list);
+    }
+    server->sendNumeric(fd, RPL_WHOISSERVER, target.nickname, server->SERVER_NAME);
+    server->sendNumeric(fd, RPL_ENDOFWHOIS, target.nickname);
+}
+
+void handleUserhost(Server* server, int fd, const std::vector<std::string>& params) {
+    std::string response;
+    for (size_t i = 0; i < params.size(); ++i) {
+        int target_fd = server->getClientFdByNick(params[i]);
+        if (target_fd != -1) {
+            ClientInfo& target = server->getClient(target_fd);
+            if (i > 0) response += " ";
+            response += target.nickname + "=+" + target.username + "@" + target.hostname;
+        }
+    }
+    server->sendNumeric(fd, RPL_USERHOST, response);
+}
+
+void handleOper(Server* server, int fd, const std::vector<std::string>& params) {
+    ClientInfo& client = server->getClient(fd);
+    // Any operator name is accepted; the server has a single oper password
+    if (server->getOperPassword().empty()) {
+        server->sendNumeric(fd, ERR_NOOPERHOST);
+        return;
+    }
+    if (params[1] != server->getOperPassword()) {
+        server->sendNumeric(fd, ERR_PASSWDMISMATCH);
+        return;
+    }
+    client.oper = true;
+    server->sendNumeric(fd, RPL_YOUREOPER);
+}
+
+// STATS for operators: m lists commands received with handler latency,
+// u the uptime, t traffic, connection and flood-control counters
+void handleStats(Server* server, int fd, const std::vector<std::string>& params) {
+    ClientInfo& client = server->getClient(fd);
+    if (!client.oper) {
+        server->sendNumeric(fd, ERR_NOPRIVILEGES);
+        return;
+    }
+    std::string letter = params[0].substr(0, 1);
+    MetricsSnapshot stats;
+    server->collectMetrics(stats);
+
+    if (letter == "m") {
+        for (size_t i = 0; i < stats.commands.size(); ++i) {
+            if (stats.commands[i] == 0) continue;
+            const Histogram& latency = stats.latency[i];
+            server->sendNumeric(fd, RPL_STATSCOMMANDS, stats.commandNames[i], stats.commands[i],
+                                latency.quantile(0.5), latency.quantile(0.99), latency.max());
+        }
+    } else if (letter == "u") {
+        unsigned long up = stats.uptimeSeconds;
+        std::ostringstream text;
+        text << up / 86400 << " days " << up / 3600 % 24 << ':'
+             << (up / 60 % 60 < 10 ? "0" : "") << up / 60 % 60 << ':'
+             << (up % 60 < 10 ? "0" : "") << up % 60;
+        server->sendNumeric(fd, RPL_STATSUPTIME, text.str());
+    } else if (letter == "t") {
+        const char* names[] = { "clients", "channels", "accepts", "bytes_in", "bytes_out", "messages_out",
+                                "sendq_bytes", "throttle_events", "throttled_clients", "log_dropped",
+                                "lock_waits", "lock_wait_us" };
+        unsigned long values[] = { stats.clients, stats.channels, stats.accepts, stats.bytesIn, stats.bytesOut,
+                                   stats.messagesOut, stats.sendqBytes, stats.throttleEvents,
+                                   stats.throttledClients, stats.logDropped, stats.lockWaits,
+                                   stats.lockWaitNs / 1000 };
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+            std::ostringstream line;
+            line << names[i] << ' ' << values[i];
+            server->sendNumeric(fd, RPL_STATSDEBUG, letter, line.str());
+        }
+        for (size_t i = 0; i < DISCONNECT_COUNT; ++i) {
+            std::ostringstream line;
+            line << "disconnects_" << disconnectReasonName(static_cast<DisconnectReason>(i)) << ' ' << stats.disconnects[i];
+            server->sendNumeric(fd, RPL_STATSDEBUG, letter, line.str());
+        }
+    }
+    server->sendNumeric(fd, RPL_ENDOFSTATS, letter);
+}
+
+// Command table: one entry per command, with the checks processMessage runs
+// before calling the handler. Cost is the flood-control penalty per use.
+static const CommandEntry COMMANDS[] = {
+    //  name        handler          minParams  needsRegistration  cost
+    { "PASS",     handlePass,      1, false, 1 },
+    { "NICK",     handleNick,      0, false, 2 },
+    { "USER",     handleUser,      4, false, 1 },
+    { "CAP",      handleCap,       0, false, 0 },
+    { "PING",     handlePing,      0, false, 1 },
+    { "PONG",     handlePong,      0, false, 0 },
+    { "QUIT",     handleQuit,      0, false, 0 },
+    { "JOIN",     handleJoin,      1, true,  2 },
+    { "PART",     handlePart,      1, true,  1 },
+    { "PRIVMSG",  handlePrivMsg,   2, true,  1 },
+    { "TOPIC",    handleTopic,     1, true,  1 },
+    { "NAMES",    handleNames,     0, true,  2 },
+    { "MODE",     handleMode,      1, true,  1 },
+    { "KICK",     handleKick,      2, true,  1 },
+    { "INVITE",   handleInvite,    2, true,  2 },
+    { "WHO",      handleWho,       0, true,  3 },
+    { "WHOIS",    handleWhois,     0, true,  2 },
+    { "USERHOST", handleUserhost,  1, true,  1 },
+    { "LIST",     handleList,      0, true,  5 },
+    { "OPER",     handleOper,      2, true,  2 },
+    { "STATS",    handleStats,     1, true,  2 }
+};
+
+static const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+static const size_t MAX_COMMAND_LENGTH = 16;
+
+// Buckets keyed by (length, first letter), built once at startup. Each
+// bucket holds at most a couple of names, so lookup cost stays flat as
+// commands are added.
+static short g_bucketHead[MAX_COMMAND_LENGTH + 1][26];
+static short g_bucketNext[COMMAND_COUNT];
+
+static void buildCommandTable() {
+    for (size_t len = 0; len <= MAX_COMMAND_LENGTH; ++len) {
+        for (size_t c = 0; c < 26; ++c) {
+            g_bucketHead[len][c] = -1;
+        }
+    }
+    // Insert in reverse so each chain keeps table order
+    for (size_t i = COMMAND_COUNT; i-- > 0; ) {
+        size_t len = std::strlen(COMMANDS[i].name);
+        size_t letter = COMMANDS[i].name[0] - 'A';
+        g_bucketNext[i] = g_bucketHead[len][letter];
+        g_bucketHead[len][letter] = static_cast<short>(i);
+    }
+}
+
+static struct CommandTableInit {
+    CommandTableInit() { buildCommandTable(); }
+} g_commandTableInit;
+
+size_t commandTableSize() {
+    return COMMAND_COUNT;
+}
+
+const CommandEntry& commandAt(size_t index) {
+    return COMMANDS[index];
+}
+
+size_t commandIndex(const CommandEntry* command) {
+    return static_cast<size_t>(command - COMMANDS);
+}
+
+const CommandEntry* findCommand(const char* name, size_t len) {
+    if (len == 0 || len > MAX_COMMAND_LENGTH) return NULL;
+    char first = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+    if (first < 'A' || first > 'Z') return NULL;
+
+    for (short i = g_bucketHead[len][first - 'A']; i != -1; i = g_bucketNext[i]) {
+        const char* candidate = COMMANDS[i].name;
+        size_t k = 1;
+        while (k < len && std::toupper(static_cast<unsigned char>(name[k])) == candidate[k]) {
+            ++k;
+        }
+        if (k == len) return &COMMANDS[i];
+    }
+    return NULL;
 }
@@ -1,8 +1,103 @@
 #include "Server.hpp"
 
+static void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <port> <password> [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --sendq=BYTES     queued output per client before disconnect (default 1048576)" << std::endl;
+    std::cerr << "  --recvbuf=BYTES   bytes read per recv() call, 512 to 1048576 (default 16384)" << std::endl;
+    std::cerr << "  --threads=N       event-loop threads, 1 to 256 (default 1); socket I/O runs in parallel," << std::endl;
+    std::cerr << "                    command handling is serialized by one shared lock" << std::endl;
+    std::cerr << "  --backlog=N       pending connections per listener, 1 to 65535 (default " << SOMAXCONN << ")" << std::endl;
+    std::cerr << "  --flood-rate=N    flood-control cost units regained per second, 0 disables (default 10)" << std::endl;
+    std::cerr << "  --flood-burst=N   cost units a client may spend at once, 1 to 1000 (default 20)" << std::endl;
+    std::cerr << "  --oper-password=PASSWORD  enables OPER with this password" << std::endl;
+    std::cerr << "  --oper-flood-exempt=0|1   operators bypass flood control (default 1)" << std::endl;
+    std::cerr << "  --register-timeout=SECONDS  time allowed to register, 1 to 86400 (default 60)" << std::endl;
+    std::cerr << "  --ping-interval=SECONDS     silence before the server sends PING, 1 to 86400 (default 120)" << std::endl;
+    std::cerr << "  --ping-timeout=SECONDS      wait for a reply to that PING, 1 to 86400 (default 60)" << std::endl;
+    std::cerr << "  --log-level=LEVEL           error, warn, info or debug (default info)" << std::endl;
+    std::cerr << "  --metrics-port=PORT         serve Prometheus metrics on 127.0.0.1:PORT (default off)" << std::endl;
+    std::cerr << "  --capture=FILE              record every inbound line to FILE, for bench/replay" << std::endl;
+}
+
+// Parses the value of a --name=NUMBER option
+static bool parseSize(const std::string& value, size_t& out) {
+    if (value.empty() || value[0] == '-') return false;
+    char* endptr;
+    errno = 0;
+    unsigned long v = std::strtoul(value.c_str(), &endptr, 10);
+    if (errno != 0 || *endptr != '\0') return false;
+    out = static_cast<size_t>(v);
+    return true;
+}
+
+// Applies one optional "--name=value" argument to the config
+static bool parseOption(const std::string& arg, ServerConfig& config) {
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+    std::string name = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+
+    if (name == "sendq") {
+        return parseSize(value, config.sendQueueMax) && config.sendQueueMax > 0;
+    }
+    if (name == "recvbuf") {
+        return parseSize(value, config.recvBufferSize)
+            && config.recvBufferSize >= 512 && config.recvBufferSize <= 1024 * 1024;
+    }
+    if (name == "threads") {
+        return parseSize(value, config.threads) && config.threads >= 1 && config.threads <= 256;
+    }
+    if (name == "flood-rate") {
+        return parseSize(value, config.floodRate) && config.floodRate <= 1000000;
+    }
+    if (name == "flood-burst") {
+        return parseSize(value, config.floodBurst) && config.floodBurst >= 1 && config.floodBurst <= 1000;
+    }
+    if (name == "oper-password") {
+        config.operPassword = value;
+        return !value.empty();
+    }
+    if (name == "oper-flood-exempt") {
+        size_t exempt;
+        if (!parseSize(value, exempt) || exempt > 1) return false;
+        config.operFloodExempt = exempt == 1;
+        return true;
+    }
+    if (name == "register-timeout") {
+        return parseSize(value, config.registerTimeout) && config.registerTimeout >= 1 && config.registerTimeout <= 86400;
+    }
+    if (name == "ping-interval") {
+        return parseSize(value, config.pingInterval) && config.pingInterval >= 1 && config.pingInterval <= 86400;
+    }
+    if (name == "ping-timeout") {
+        return parseSize(value, config.pingTimeout) && config.pingTimeout >= 1 && config.pingTimeout <= 86400;
+    }
+    if (name == "log-level") {
+        return Logger::parseLevel(value, config.logLevel);
+    }
+    if (name == "metrics-port") {
+        size_t port;
+        if (!parseSize(value, port) || port < 1 || port > 65535) return false;
+        config.metricsPort = static_cast<int>(port);
+        return true;
+    }
+    if (name == "capture") {
+        config.capturePath = value;
+        return !value.empty();
+    }
+    if (name == "backlog") {
+        size_t backlog;
+        if (!parseSize(value, backlog) || backlog < 1 || backlog > 65535) return false;
+        config.listenBacklog = static_cast<int>(backlog);
+        return true;
+    }
+    return false;
+}
+
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>" << std::endl;
+    if (argc < 3) {
+        printUsage(argv[0]);
         return 1;
     }
 
@@ -29,13 +124,26 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    ServerConfig config;
+    for (int i = 3; i < argc; ++i) {
+        if (!parseOption(argv[i], config)) {
+            std::cerr << "Error: Invalid option " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // The writer thread must exist before the server's, and outlive them
+    Logger::start(config.logLevel);
+    int status = 0;
     try {
-        Server server(port, password);
+        Server server(port, password, config);
         server.run();
     } catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+        LOG_ERROR("Error: " << e.what());
+        status = 1;
     }
+    Logger::stop();
 
-    return 0;
+    return status;
 }
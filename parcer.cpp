@@ -5,73 +5,120 @@
 #include <sstream>
 #include <iostream>
 
-std::vector<std::string> parseMessage(const std::string& message) {
-    std::vector<std::string> tokens;
-    
-    if (message.empty()) return tokens;
-    
+static Slice makeSlice(size_t start, size_t end) {
+    Slice slice;
+    slice.offset = start;
+    slice.length = end - start;
+    return slice;
+}
+
+bool parseMessageView(const char* line, size_t len, MessageView& out) {
+    out.base = line;
+    out.tags = makeSlice(0, 0);
+    out.prefix = makeSlice(0, 0);
+    out.command = makeSlice(0, 0);
+    out.paramCount = 0;
+
+    // Ignore any line terminator left on the input
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == '\n')) {
+        len--;
+    }
+
     // Find the start of the message (skip any leading whitespace)
     size_t pos = 0;
-    while (pos < message.length() && (message[pos] == ' ' || message[pos] == '\t')) {
+    while (pos < len && (line[pos] == ' ' || line[pos] == '\t')) {
         pos++;
     }
-    // Parse the message according to IRC RFC 2812
-    // Format: [':' prefix SPACE] command [SPACE params] [SPACE ':' trailing]
+    // Parse the message according to IRC RFC 2812 plus IRCv3 message tags
 
-    // Skip prefix if present (starts with ':')
-    if (pos < message.length() && message[pos] == ':') {
-        // Skip to next space (end of prefix)
-        while (pos < message.length() && message[pos] != ' ') {
+    // Tags if present (starts with '@')
+    if (pos < len && line[pos] == '@') {
+        size_t start = ++pos;
+        while (pos < len && line[pos] != ' ') {
             pos++;
         }
-        // Skip spaces after prefix
-        while (pos < message.length() && message[pos] == ' ') {
+        out.tags = makeSlice(start, pos);
+        while (pos < len && line[pos] == ' ') {
             pos++;
         }
     }
-    // Parse command and parameters
-    while (pos < message.length()) {
-        if (message[pos] == ' ') {
+
+    // Prefix if present (starts with ':')
+    if (pos < len && line[pos] == ':') {
+        size_t start = ++pos;
+        while (pos < len && line[pos] != ' ') {
+            pos++;
+        }
+        out.prefix = makeSlice(start, pos);
+        while (pos < len && line[pos] == ' ') {
+            pos++;
+        }
+    }
+
+    // Command
+    size_t start = pos;
+    while (pos < len && line[pos] != ' ') {
+        pos++;
+    }
+    if (pos == start) return false;
+    out.command = makeSlice(start, pos);
+
+    // Parameters
+    while (pos < len) {
+        if (line[pos] == ' ') {
             // Skip multiple spaces
-            while (pos < message.length() && message[pos] == ' ') {
-                pos++;
-            }
+            pos++;
             continue;
         }
-        
-        if (message[pos] == ':') {
-            // Trailing parameter - everything after ':' until end of line
-            pos++; // Skip the ':'
-            std::string trailing = message.substr(pos);
-            // Remove trailing \r\n if present
-            size_t end = trailing.find_last_not_of("\r\n");
-            if (end != std::string::npos) {
-                trailing = trailing.substr(0, end + 1);
-            }
-            if (!trailing.empty()) {
-                tokens.push_back(trailing);
+
+        if (line[pos] == ':' || out.paramCount == MessageView::MAX_PARAMS - 1) {
+            // Trailing parameter - everything until end of line. The last of
+            // the 15 slots takes the rest of the line even without ':'
+            if (line[pos] == ':') pos++;
+            if (pos < len) {
+                out.params[out.paramCount++] = makeSlice(pos, len);
             }
             break;
-        } else {
-            // Regular parameter - until next space or ':'
-            size_t start = pos;
-            while (pos < message.length() && message[pos] != ' ' && message[pos] != ':') {
-                pos++;
-            }
-            std::string param = message.substr(start, pos - start);
-            // Remove trailing \r\n if it's the last parameter
-            size_t end = param.find_last_not_of("\r\n");
-            if (end != std::string::npos) {
-                param = param.substr(0, end + 1);
-            }
-            if (!param.empty()) {
-                tokens.push_back(param);
-            }
         }
+
+        // Regular parameter - until next space
+        start = pos;
+        while (pos < len && line[pos] != ' ') {
+            pos++;
+        }
+        out.params[out.paramCount++] = makeSlice(start, pos);
+    }
+    return true;
+}
+
+bool isLineTooLong(const char* line, size_t len) {
+    size_t tagsLen = 0;
+    if (len > 0 && line[0] == '@') {
+        while (tagsLen < len && line[tagsLen] != ' ') {
+            tagsLen++;
+        }
+        // Include the separating space in the tag budget
+        if (tagsLen < len) tagsLen++;
+        if (tagsLen > MAX_TAGS_LENGTH) return true;
+    }
+    // The 512 byte budget includes the CR/LF that was already stripped
+    return len - tagsLen > MAX_MESSAGE_LENGTH - 2;
+}
+
+// Convenience wrapper returning the command followed by its parameters
+std::vector<std::string> parseMessage(const std::string& message) {
+    std::vector<std::string> tokens;
+    MessageView view;
+    if (!parseMessageView(message.data(), message.length(), view)) {
+        return tokens;
+    }
+    tokens.push_back(view.str(view.command));
+    for (size_t i = 0; i < view.paramCount; ++i) {
+        tokens.push_back(view.str(view.params[i]));
     }
-    
     return tokens;
 }
+
 // Helper function: Split string by commas
 std::vector<std::string> splitByComma(const std::string& str) {
     std::vector<std::string> result;
@@ -105,6 +152,31 @@ bool stringToInt(const std::string& str, int& result) {
     return true;
 }
 
+// Helper function: Wildcard match. On a mismatch the last '*' absorbs one
+// more character and matching resumes after it, so this never recurses.
+bool matchMask(const std::string& mask, const std::string& name) {
+    size_t m = 0;
+    size_t n = 0;
+    size_t star = std::string::npos;
+    size_t resume = 0;
+    while (n < name.length()) {
+        if (m < mask.length() && mask[m] == '*') {
+            star = m++;
+            resume = n;
+        } else if (m < mask.length() && (mask[m] == '?' || ircToLower(mask[m]) == ircToLower(name[n]))) {
+            ++m;
+            ++n;
+        } else if (star != std::string::npos) {
+            m = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (m < mask.length() && mask[m] == '*') ++m;
+    return m == mask.length();
+}
+
 // Helper function: Check if nickname is valid
 bool isValidNickname(const std::string& nick) {
     if (nick.empty() || nick.length() > 9) return false;
@@ -7,10 +7,56 @@
 // Forward declaration
 class Server;
 
+// Byte range inside the line a MessageView was parsed from
+struct Slice {
+    size_t offset;
+    size_t length;
+};
+
+// One parsed IRC line. Every field is a slice into the caller's buffer, so
+// parsing copies nothing and never touches the heap; the buffer must outlive
+// the view.
+// Format: ['@' tags SPACE] [':' prefix SPACE] command [params] [SPACE ':' trailing]
+struct MessageView {
+    static const size_t MAX_PARAMS = 15;
+
+    const char* base;
+    Slice tags;                     // IRCv3 tags without the '@', empty when absent
+    Slice prefix;                   // Without the ':', empty when absent
+    Slice command;
+    Slice params[MAX_PARAMS];
+    size_t paramCount;
+
+    const char* data(const Slice& s) const { return base + s.offset; }
+    std::string str(const Slice& s) const { return std::string(base + s.offset, s.length); }
+    const char* paramData(size_t i) const { return base + params[i].offset; }
+    size_t paramLength(size_t i) const { return params[i].length; }
+};
+
+// Returns false when the line holds no command
+bool parseMessageView(const char* line, size_t len, MessageView& out);
+
+// Line limits: 512 bytes including CRLF for the message itself (RFC 1459)
+// plus up to 8191 bytes for an IRCv3 tag section, '@' and space included
+const size_t MAX_MESSAGE_LENGTH = 512;
+const size_t MAX_TAGS_LENGTH = 8191;
+const size_t MAX_LINE_LENGTH = MAX_TAGS_LENGTH + MAX_MESSAGE_LENGTH;
+
+// True when a line (without its CR/LF) breaks the limits above
+bool isLineTooLong(const char* line, size_t len);
+
 std::vector<std::string> parseMessage(const std::string& message);
 std::vector<std::string> splitByComma(const std::string& str);
 bool stringToInt(const std::string& str, int& result);
 bool isValidNickname(const std::string& nick);
+// Glob match under IRC casemapping: '*' is any run, '?' any one character
+bool matchMask(const std::string& mask, const std::string& name);
+
+// RFC 1459 casemapping as deployed: A-Z and []\^ fold to a-z and {}|~
+inline char ircToLower(char c) {
+    if (c >= 'A' && c <= '^') return static_cast<char>(c + 32);
+    return c;
+}
 
 // IRC command handlers
 void handlePass(Server* server, int fd, const std::vector<std::string>& params);
@@ -20,11 +66,37 @@ void handleJoin(Server* server, int fd, const std::vector<std::string>& params);
 void handlePrivMsg(Server* server, int fd, const std::vector<std::string>& params);
 void handleQuit(Server* server, int fd, const std::vector<std::string>& params);
 void handlePing(Server* server, int fd, const std::vector<std::string>& params);
+void handlePong(Server* server, int fd, const std::vector<std::string>& params);
 void handlePart(Server* server, int fd, const std::vector<std::string>& params);
 void handleMode(Server* server, int fd, const std::vector<std::string>& params);
 void handleWho(Server* server, int fd, const std::vector<std::string>& params);
 void handleList(Server* server, int fd, const std::vector<std::string>& params);
 void handleKick(Server* server, int fd, const std::vector<std::string>& params);
 void handleInvite(Server* server, int fd, const std::vector<std::string>& params);
+void handleCap(Server* server, int fd, const std::vector<std::string>& params);
+void handleTopic(Server* server, int fd, const std::vector<std::string>& params);
+void handleNames(Server* server, int fd, const std::vector<std::string>& params);
+void handleWhois(Server* server, int fd, const std::vector<std::string>& params);
+void handleUserhost(Server* server, int fd, const std::vector<std::string>& params);
+void handleOper(Server* server, int fd, const std::vector<std::string>& params);
+void handleStats(Server* server, int fd, const std::vector<std::string>& params);
+
+typedef void (*CommandHandler)(Server* server, int fd, const std::vector<std::string>& params);
+
+// Dispatch table entry, see COMMANDS in commands.cpp
+struct CommandEntry {
+    const char* name;               // Upper case
+    CommandHandler handler;
+    size_t minParams;               // Fewer parameters get 461 before the handler runs
+    bool needsRegistration;         // Unregistered clients get 451 before the handler runs
+    unsigned int cost;              // Flood control penalty per use
+};
+
+// Case-insensitive lookup, NULL for unknown commands
+const CommandEntry* findCommand(const char* name, size_t len);
+// The table by position, for per-command statistics
+size_t commandTableSize();
+const CommandEntry& commandAt(size_t index);
+size_t commandIndex(const CommandEntry* command);
 
 #endif // PARCER_HPP
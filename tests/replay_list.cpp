@@ -0,0 +1,96 @@
+// Regression test for bench/replay: a command that runs as a multi-step
+// task (LIST over more channels than one step covers) must not leave the
+// lines its client sends afterwards undispatched. Writes a capture in which
+// one client creates 1500 channels and another lists them and then keeps
+// talking, replays it with the given binary and checks the per-command
+// counters it prints.
+//   ./tests/replay_list <replay binary> [capture file]
+
+#include "../Capture.hpp"
+#include "../Logger.hpp"
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+static const char* PASSWORD = "testpw";
+static const int CHANNELS = 1500;
+
+static void line(CaptureWriter& capture, unsigned long conn, const std::string& text) {
+    capture.line(conn, text.data(), text.size());
+}
+
+static void writeCapture(const std::string& path) {
+    CaptureWriter capture(path);
+    capture.connect(1);
+    line(capture, 1, std::string("PASS ") + PASSWORD);
+    line(capture, 1, "NICK owner");
+    line(capture, 1, "USER owner 0 * :owner");
+    for (int i = 0; i < CHANNELS; ++i) {
+        char join[32];
+        std::snprintf(join, sizeof(join), "JOIN #chan%d", i);
+        line(capture, 1, join);
+    }
+    capture.connect(2);
+    line(capture, 2, std::string("PASS ") + PASSWORD);
+    line(capture, 2, "NICK lister");
+    line(capture, 2, "USER lister 0 * :lister");
+    line(capture, 2, "LIST");
+    line(capture, 2, "JOIN #after");
+    line(capture, 2, "PRIVMSG owner :after the list");
+    line(capture, 2, "PRIVMSG #after :after the list");
+    line(capture, 2, "QUIT :done");
+    line(capture, 1, "QUIT :done");
+    capture.disconnect(1);
+    capture.disconnect(2);
+}
+
+// ircserv_received_messages_total per command, from the replay's --metrics output
+static bool readCounts(const std::string& command, std::map<std::string, unsigned long>& counts) {
+    FILE* out = popen(command.c_str(), "r");
+    if (out == NULL) return false;
+    char buf[1024];
+    const char prefix[] = "ircserv_received_messages_total{command=\"";
+    while (std::fgets(buf, sizeof(buf), out) != NULL) {
+        if (std::strncmp(buf, prefix, sizeof(prefix) - 1) != 0) continue;
+        char* name = buf + sizeof(prefix) - 1;
+        char* end = std::strchr(name, '"');
+        if (end == NULL || end[1] != '}') continue;
+        counts[std::string(name, end)] = std::strtoul(end + 2, NULL, 10);
+    }
+    return pclose(out) == 0;
+}
+
+static bool expect(std::map<std::string, unsigned long>& counts, const char* command, unsigned long want) {
+    if (counts[command] == want) return true;
+    std::fprintf(stderr, "FAIL: %s dispatched %lu times, expected %lu\n", command, counts[command], want);
+    return false;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <replay binary> [capture file]\n", argv[0]);
+        return 1;
+    }
+    std::string path = argc > 2 ? argv[2] : "tests/replay_list.cap";
+    Logger::start(LOG_LEVEL_ERROR);
+    writeCapture(path);
+    Logger::stop();
+
+    std::map<std::string, unsigned long> counts;
+    bool ran = readCounts(std::string(argv[1]) + " " + path + " " + PASSWORD + " --metrics", counts);
+    unlink(path.c_str());
+    if (!ran) {
+        std::fprintf(stderr, "FAIL: %s did not run\n", argv[1]);
+        return 1;
+    }
+    bool ok = expect(counts, "LIST", 1);
+    ok = expect(counts, "JOIN", CHANNELS + 1) && ok;
+    ok = expect(counts, "PRIVMSG", 2) && ok;
+    ok = expect(counts, "QUIT", 2) && ok;
+    if (!ok) return 1;
+    std::printf("ok\n");
+    return 0;
+}
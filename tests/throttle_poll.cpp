@@ -0,0 +1,148 @@
+// Regression test for flood control on the level-triggered poll() backend:
+// a throttled client's unread input stays in the kernel, and the event loop
+// must not be woken for it on every iteration. Starts the given server (a
+// `make USE_POLL=1` build, see `make test`), floods it from one client, then
+// checks that the server stays idle while that client is throttled and
+// still answers another one.
+//   ./tests/throttle_poll <server> [port]
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+static const char* PASSWORD = "testpw";
+// CPU the server may use while the only busy client is throttled
+static const double IDLE_CPU_SECONDS = 0.2;
+static const unsigned int IDLE_WINDOW_US = 2000000;
+
+static int connectTo(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static pid_t spawnServer(const char* server, int port) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        char portArg[16];
+        std::snprintf(portArg, sizeof(portArg), "%d", port);
+        execl(server, server, portArg, PASSWORD, "--flood-rate=1", "--flood-burst=5", "--recvbuf=512",
+              "--log-level=error",
+              static_cast<char*>(NULL));
+        _exit(127);
+    }
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        int fd = connectTo(port);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+// User plus system time of a process, in seconds
+static double cpuSeconds(pid_t pid) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+    FILE* file = std::fopen(path, "r");
+    if (file == NULL) return -1;
+    char buf[1024];
+    size_t n = std::fread(buf, 1, sizeof(buf) - 1, file);
+    std::fclose(file);
+    buf[n] = '\0';
+    // Fields after the parenthesised command name; utime and stime are 14 and 15
+    const char* p = std::strrchr(buf, ')');
+    if (p == NULL) return -1;
+    unsigned long utime = 0, stime = 0;
+    if (std::sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) return -1;
+    return static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+}
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool awaitReply(int fd, int timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) != 1) return false;
+    char buf[512];
+    return recv(fd, buf, sizeof(buf), 0) > 0;
+}
+
+static int fail(pid_t server, const char* what) {
+    std::fprintf(stderr, "FAIL: %s\n", what);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <server> [port]\n", argv[0]);
+        return 1;
+    }
+    int port = argc > 2 ? std::atoi(argv[2]) : 16668;
+    pid_t server = spawnServer(argv[1], port);
+    if (server < 0) {
+        std::fprintf(stderr, "FAIL: could not start %s on port %d\n", argv[1], port);
+        return 1;
+    }
+
+    // Far more than the burst allows: at one unit per second the client
+    // stays throttled for the whole test, and with the flood larger than
+    // the server's 512-byte reads most of it is left unread in the kernel
+    int flooder = connectTo(port);
+    std::string flood = std::string("PASS ") + PASSWORD + "\r\nNICK flooder\r\nUSER f 0 * :f\r\n";
+    for (int i = 0; i < 2000; ++i) flood += "PING :flood\r\n";
+    if (flooder < 0 || !sendAll(flooder, flood)) return fail(server, "could not send the flood");
+    usleep(300000);
+
+    double before = cpuSeconds(server);
+    if (before < 0) return fail(server, "cannot read the server's CPU time");
+    usleep(IDLE_WINDOW_US);
+    double used = cpuSeconds(server) - before;
+    std::printf("server CPU while a client is throttled: %.3f s in %.1f s\n", used, IDLE_WINDOW_US / 1e6);
+    if (used > IDLE_CPU_SECONDS) return fail(server, "the event loop spins while a client is throttled");
+
+    int other = connectTo(port);
+    if (other < 0 || !sendAll(other, "PING :alive\r\n") || !awaitReply(other, 1000)) {
+        return fail(server, "server does not answer other clients");
+    }
+    close(other);
+    close(flooder);
+    kill(server, SIGINT);
+    waitpid(server, NULL, 0);
+    std::printf("ok\n");
+    return 0;
+}